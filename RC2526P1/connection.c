@@ -0,0 +1,753 @@
+#define _GNU_SOURCE
+
+#include "connection.h"
+#include "server_logic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define CONN_TABLE_INITIAL_CAPACITY 64
+
+// Capacidade inicial da fila de saída; acima de CONN_OUT_LOW_WATERMARK, a memória é libertada quando a fila esvazia
+#define OUT_QUEUE_INITIAL_CAPACITY 4096
+
+/*
+ * Resultado de cada passo da máquina de estados de uma conexão.
+ * - IO_WAIT: o socket não tem mais dados/espaço, aguardar pelo próximo evento.
+ * - IO_NEXT: a fase da conexão mudou, continuar a processar.
+ * - IO_CLOSE: erro ou fim da conexão, fechar.
+ */
+typedef enum {
+    IO_WAIT,
+    IO_NEXT,
+    IO_CLOSE
+} IoResult;
+
+/**
+ * Número de bytes da fila por enviar
+ */
+size_t out_queue_pending(const OutQueue *queue) {
+    return queue->len - queue->off;
+}
+
+/**
+ * Garante espaço para size bytes no fim da fila e devolve o endereço onde escrevê-los
+ * (ou NULL se não houver memória). Os bytes só passam a contar depois de out_queue_commit.
+ */
+char *out_queue_reserve(OutQueue *queue, size_t size) {
+    // reaproveitar o espaço já enviado no início do buffer antes de crescer
+    if (queue->off > 0 && queue->len + size > queue->cap) {
+        memmove(queue->data, queue->data + queue->off, queue->len - queue->off);
+        queue->len -= queue->off;
+        queue->off = 0;
+    }
+
+    if (queue->len + size > queue->cap) {
+        size_t new_cap = queue->cap > 0 ? queue->cap : OUT_QUEUE_INITIAL_CAPACITY;
+        while (new_cap < queue->len + size) {
+            new_cap *= 2;
+        }
+        char *new_data = realloc(queue->data, new_cap);
+        if (new_data == NULL) return NULL;
+        queue->data = new_data;
+        queue->cap = new_cap;
+    }
+    return queue->data + queue->len;
+}
+
+/**
+ * Acrescenta à fila os size bytes escritos no espaço devolvido por out_queue_reserve
+ */
+void out_queue_commit(OutQueue *queue, size_t size) {
+    queue->len += size;
+}
+
+/**
+ * Retira da fila os size bytes já enviados
+ */
+void out_queue_consume(OutQueue *queue, size_t size) {
+    queue->off += size;
+    if (queue->off < queue->len) return;
+
+    queue->off = 0;
+    queue->len = 0;
+    // uma fila que cresceu muito (por exemplo, com um cliente lento) não fica com a memória reservada
+    if (queue->cap > CONN_OUT_LOW_WATERMARK) {
+        out_queue_free(queue);
+    }
+}
+
+/**
+ * Liberta o buffer da fila
+ */
+void out_queue_free(OutQueue *queue) {
+    free(queue->data);
+    queue->data = NULL;
+    queue->off = 0;
+    queue->len = 0;
+    queue->cap = 0;
+}
+
+/**
+ * Inicializa uma tabela de conexões vazia
+ */
+void conn_table_init(ConnTable *table) {
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->idle_head = NULL;
+    table->idle_tail = NULL;
+}
+
+/**
+ * Relógio monotónico em segundos, imune a alterações da hora do sistema
+ */
+static time_t conn_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * Retira uma conexão da lista de inatividade
+ */
+void conn_table_untrack(ConnTable *table, Connection *conn) {
+    if (conn->idle_prev != NULL) conn->idle_prev->idle_next = conn->idle_next;
+    else if (table->idle_head == conn) table->idle_head = conn->idle_next;
+    if (conn->idle_next != NULL) conn->idle_next->idle_prev = conn->idle_prev;
+    else if (table->idle_tail == conn) table->idle_tail = conn->idle_prev;
+    conn->idle_prev = NULL;
+    conn->idle_next = NULL;
+}
+
+/**
+ * Regista atividade numa conexão, movendo-a para o fim da lista de inatividade
+ */
+void conn_table_touch(ConnTable *table, Connection *conn) {
+    if (conn->idle_expired) return;
+
+    conn->last_active = conn_clock();
+    if (table->idle_tail == conn) return;
+
+    conn_table_untrack(table, conn);
+    conn->idle_prev = table->idle_tail;
+    if (table->idle_tail != NULL) table->idle_tail->idle_next = conn;
+    else table->idle_head = conn;
+    table->idle_tail = conn;
+}
+
+/**
+ * Devolve a conexão inativa há mais tempo, se esta tiver excedido idle_timeout segundos
+ */
+Connection *conn_table_next_expired(ConnTable *table, int idle_timeout) {
+    Connection *oldest = table->idle_head;
+    if (idle_timeout <= 0 || oldest == NULL) return NULL;
+    return conn_clock() - oldest->last_active >= idle_timeout ? oldest : NULL;
+}
+
+/**
+ * Garante que a tabela tem espaço para o índice fd, duplicando a capacidade se necessário
+ */
+static bool conn_table_reserve(ConnTable *table, int fd) {
+    if (fd < table->capacity) return true;
+
+    int new_capacity = table->capacity > 0 ? table->capacity : CONN_TABLE_INITIAL_CAPACITY;
+    while (new_capacity <= fd) {
+        new_capacity *= 2;
+    }
+
+    Connection **new_slots = realloc(table->slots, new_capacity * sizeof(Connection *));
+    if (new_slots == NULL) return false;
+
+    memset(new_slots + table->capacity, 0, (new_capacity - table->capacity) * sizeof(Connection *));
+    table->slots = new_slots;
+    table->capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Regista uma nova conexão para o descritor fd. Devolve NULL se não houver memória.
+ */
+Connection *conn_table_add(ConnTable *table, int fd, const struct sockaddr_in *addr) {
+    if (fd < 0 || !conn_table_reserve(table, fd)) return NULL;
+
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (conn == NULL) return NULL;
+
+    conn->fd = fd;
+    if (addr != NULL) conn->addr = *addr;
+    conn->phase = CONN_READ_REQUEST;
+    conn->body_fd = -1;
+    conn->file_fd = -1;
+    conn->pipe_fds[0] = -1;
+    conn->pipe_fds[1] = -1;
+
+    table->slots[fd] = conn;
+    table->count++;
+    conn_table_touch(table, conn);
+    return conn;
+}
+
+/**
+ * Obtém a conexão associada ao descritor fd (ou NULL se não existir)
+ */
+Connection *conn_table_get(ConnTable *table, int fd) {
+    if (fd < 0 || fd >= table->capacity) return NULL;
+    return table->slots[fd];
+}
+
+/**
+ * Cria o pipe intermédio usado pelo splice, com a maior capacidade que o kernel permitir
+ */
+static bool conn_open_pipe(Connection *conn) {
+    if (conn->pipe_fds[0] >= 0) return true;
+    if (pipe2(conn->pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+        return false;
+    }
+    // um pipe maior reduz o número de chamadas splice; se o limite do sistema for menor, fica o valor por defeito
+    fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, CONN_PIPE_SIZE);
+    return true;
+}
+
+/**
+ * Fecha o pipe intermédio, descartando os dados que ainda lá estejam
+ */
+static void conn_close_pipe(Connection *conn) {
+    if (conn->pipe_fds[0] >= 0) close(conn->pipe_fds[0]);
+    if (conn->pipe_fds[1] >= 0) close(conn->pipe_fds[1]);
+    conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+    conn->pipe_len = 0;
+}
+
+/**
+ * Liberta os recursos de uma conexão, descartando um upload incompleto
+ */
+static void conn_release(Connection *conn) {
+    if (conn->phase == CONN_READ_BODY && !conn->body_discard) {
+        complete_create_request(conn, NULL, false, false);
+    }
+    if (conn->body_fd >= 0) close(conn->body_fd);
+    if (conn->file_fd >= 0) close(conn->file_fd);
+    conn_close_pipe(conn);
+    out_queue_free(&conn->out);
+    free(conn->body_chunk);
+    free(conn);
+}
+
+/**
+ * Liberta a conexão associada ao descritor fd (não fecha o socket)
+ */
+void conn_table_remove(ConnTable *table, int fd) {
+    Connection *conn = conn_table_get(table, fd);
+    if (conn == NULL) return;
+
+    conn_table_untrack(table, conn);
+    conn_release(conn);
+    table->slots[fd] = NULL;
+    table->count--;
+}
+
+/**
+ * Liberta todas as conexões e a própria tabela
+ */
+void conn_table_destroy(ConnTable *table) {
+    for (int fd = 0; fd < table->capacity; fd++) {
+        if (table->slots[fd] != NULL) {
+            conn_release(table->slots[fd]);
+        }
+    }
+    free(table->slots);
+    conn_table_init(table);
+}
+
+
+/**
+ * Processa o cabeçalho completo de um pedido, preparando a fase seguinte da conexão
+ */
+void conn_dispatch_request(Connection *conn, ServerState *server_data, bool verbose) {
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Received request from TCP client (fd: %d), processing...\n", conn->fd);
+    }
+
+    conn->phase = CONN_WRITE_RESPONSE;
+    conn->out_buf[0] = '\0';
+    conn->response_queued = false;
+
+    // bytes de in_buf que pertencem a este pedido (o CRE soma-lhes os dados do ficheiro já recebidos)
+    int header_len = tcp_request_header_length(conn->in_buf, conn->in_len);
+    conn->in_consumed = header_len > 0 ? (size_t)header_len : conn->in_len;
+    conn->requests_served++;
+
+    // pedidos terminados em '\n' são isolados dos que se seguem em pipeline durante o processamento
+    char saved = conn->in_buf[conn->in_consumed];
+    bool isolate = header_len > 0 && conn->in_buf[header_len - 1] == '\n';
+    if (isolate) conn->in_buf[conn->in_consumed] = '\0';
+
+    process_tcp_request(conn, server_data, verbose);
+
+    if (isolate) conn->in_buf[conn->in_consumed] = saved;
+
+    if (conn->phase == CONN_WRITE_RESPONSE && !conn->response_queued) {
+        conn_response_ready(conn, server_data, verbose);
+    } else if (conn->phase == CONN_SEND_FILE) {
+        // o cabeçalho do SED segue à frente do ficheiro
+        if (!conn_enqueue(conn, server_data, conn->out_buf, strlen(conn->out_buf))) conn->phase = CONN_DONE;
+    }
+}
+
+/**
+ * Acrescenta bytes à fila de saída da conexão
+ */
+bool conn_enqueue(Connection *conn, ServerState *server_data, const char *data, size_t len) {
+    char *dst = out_queue_reserve(&conn->out, len);
+    if (dst == NULL) {
+        fprintf(stderr, "Out of memory for TCP output queue (fd: %d).\n", conn->fd);
+        return false;
+    }
+    memcpy(dst, data, len);
+    out_queue_commit(&conn->out, len);
+
+    STATS_ADD(&server_data->stats, tcp_bytes_queued, len);
+    stats_update_max(&server_data->stats.tcp_queue_peak, out_queue_pending(&conn->out));
+    return true;
+}
+
+/**
+ * Indica se não se devem ler mais pedidos do cliente porque as respostas se estão a acumular:
+ * a leitura pára quando a fila passa CONN_OUT_HIGH_WATERMARK e só retoma abaixo de CONN_OUT_LOW_WATERMARK
+ */
+bool conn_output_throttled(Connection *conn, ServerState *server_data, bool verbose) {
+    size_t pending = out_queue_pending(&conn->out);
+
+    if (!conn->throttled && pending >= CONN_OUT_HIGH_WATERMARK) {
+        conn->throttled = true;
+        STATS_ADD(&server_data->stats, tcp_reads_paused, 1);
+        if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) has %zu bytes queued, pausing reads.\n", conn->fd, pending);
+    } else if (conn->throttled && pending <= CONN_OUT_LOW_WATERMARK) {
+        conn->throttled = false;
+        if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) output drained, resuming reads.\n", conn->fd);
+    }
+    return conn->throttled;
+}
+
+/**
+ * Depois de respondido um pedido, prepara uma conexão persistente para o pedido seguinte.
+ * Os bytes que já chegaram a seguir ao pedido (pedidos em pipeline) passam para o início de in_buf.
+ * Devolve false se a conexão não for persistente ou tiver atingido o limite de pedidos.
+ */
+static bool conn_next_request(Connection *conn, ServerState *server_data, bool verbose) {
+    if (!conn->keep_alive) return false;
+    if (conn->requests_served >= server_data->keepalive_max_requests) {
+        if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) reached the limit of %d requests per connection.\n", conn->fd, conn->requests_served);
+        return false;
+    }
+
+    size_t pending = conn->in_consumed < conn->in_len ? conn->in_len - conn->in_consumed : 0;
+    memmove(conn->in_buf, conn->in_buf + conn->in_len - pending, pending);
+    conn->in_len = pending;
+    conn->in_buf[conn->in_len] = '\0';
+    conn->in_consumed = 0;
+
+    conn->body_remaining = 0;
+    conn->body_discard = false;
+    conn->file_remaining = 0;
+    conn->pipe_len = 0;
+    conn->chunk_len = 0;
+    conn->chunk_off = 0;
+    conn->body_offset = 0;
+    conn->file_offset = 0;
+    conn->phase = CONN_READ_REQUEST;
+    return true;
+}
+
+/**
+ * Depois de colocada em fila toda a resposta a um pedido: uma conexão persistente passa ao
+ * pedido seguinte (a resposta é enviada entretanto); as restantes esvaziam a fila e fecham.
+ */
+static void conn_request_done(Connection *conn, ServerState *server_data, bool verbose) {
+    if (!conn_next_request(conn, server_data, verbose)) {
+        conn->phase = CONN_WRITE_RESPONSE;
+    }
+}
+
+/**
+ * Coloca a resposta construída em out_buf na fila de saída e conclui o pedido
+ */
+void conn_response_ready(Connection *conn, ServerState *server_data, bool verbose) {
+    conn->response_queued = true;
+    if (!conn_enqueue(conn, server_data, conn->out_buf, strlen(conn->out_buf))) {
+        conn->phase = CONN_DONE;
+        return;
+    }
+    conn_request_done(conn, server_data, verbose);
+}
+
+/**
+ * Conclui um SED depois de enviado o ficheiro: a resposta termina com '\n',
+ * como as restantes mensagens do protocolo
+ */
+void conn_file_sent(Connection *conn, ServerState *server_data, bool verbose) {
+    close(conn->file_fd);
+    conn->file_fd = -1;
+    conn->phase = CONN_WRITE_RESPONSE;
+    if (!conn_enqueue(conn, server_data, "\n", 1)) {
+        conn->phase = CONN_DONE;
+        return;
+    }
+    conn_request_done(conn, server_data, verbose);
+}
+
+/**
+ * Ativa ou desativa TCP_CORK: enquanto ativo, o kernel só envia segmentos cheios
+ */
+static void conn_set_cork(Connection *conn, bool cork) {
+    int value = cork ? 1 : 0;
+    if (setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0) {
+        conn->corked = cork;
+    }
+}
+
+/**
+ * Envia o que estiver na fila de saída. Devolve IO_NEXT quando a fila fica vazia.
+ */
+static IoResult conn_flush(Connection *conn) {
+    while (out_queue_pending(&conn->out) > 0) {
+        ssize_t n = write(conn->fd, conn->out.data + conn->out.off, out_queue_pending(&conn->out));
+        if (n >= 0) {
+            out_queue_consume(&conn->out, n);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IO_WAIT;
+        perror("Erro ao escrever no socket TCP do cliente");
+        return IO_CLOSE;
+    }
+
+    // retirar o TCP_CORK de um SED já concluído envia de imediato o último segmento, ainda que incompleto
+    if (conn->corked && conn->phase != CONN_SEND_FILE) {
+        conn_set_cork(conn, false);
+    }
+    return IO_NEXT;
+}
+
+/**
+ * Indica se o cabeçalho do pedido atual já está completo (ou se in_buf encheu sem o conter).
+ * Numa conexão persistente, as linhas vazias entre pedidos (por exemplo, o '\n' que termina
+ * os dados de um CRE) são descartadas.
+ */
+bool conn_request_ready(Connection *conn) {
+    if (conn->keep_alive) {
+        size_t skip = 0;
+        while (skip < conn->in_len && (conn->in_buf[skip] == '\n' || conn->in_buf[skip] == '\r')) skip++;
+        if (skip > 0) {
+            memmove(conn->in_buf, conn->in_buf + skip, conn->in_len - skip);
+            conn->in_len -= skip;
+            conn->in_buf[conn->in_len] = '\0';
+        }
+    }
+    return tcp_request_header_length(conn->in_buf, conn->in_len) > 0 || conn->in_len == CONN_REQUEST_MAX;
+}
+
+/**
+ * Acumula o cabeçalho do pedido até este estar completo
+ */
+static IoResult conn_read_request(Connection *conn, ServerState *server_data, bool verbose) {
+    while (1) {
+        // contrapressão: com demasiadas respostas por enviar, não ler mais pedidos deste cliente
+        if (conn_output_throttled(conn, server_data, verbose)) {
+            IoResult result = conn_flush(conn);
+            if (result == IO_CLOSE) return IO_CLOSE;
+            if (conn_output_throttled(conn, server_data, verbose)) return IO_WAIT;
+        }
+
+        if (conn_request_ready(conn)) {
+            conn_dispatch_request(conn, server_data, verbose);
+            return IO_NEXT;
+        }
+
+        ssize_t n = read(conn->fd, conn->in_buf + conn->in_len, CONN_REQUEST_MAX - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            conn->in_buf[conn->in_len] = '\0';
+            continue;
+        }
+
+        if (n == 0) {
+            if (conn->in_len == 0) {
+                if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected.\n", conn->fd);
+                // enviar as respostas que ainda estão em fila antes de fechar
+                conn->keep_alive = false;
+                conn->phase = CONN_WRITE_RESPONSE;
+                return IO_NEXT;
+            }
+            // o cliente terminou o envio sem completar o cabeçalho: processar o que foi recebido
+            conn->keep_alive = false;
+            conn_dispatch_request(conn, server_data, verbose);
+            return IO_NEXT;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // sem mais pedidos por agora: enviar de uma vez as respostas acumuladas
+            return conn_flush(conn) == IO_CLOSE ? IO_CLOSE : IO_WAIT;
+        }
+        perror("Erro ao ler do socket TCP do cliente");
+        return IO_CLOSE;
+    }
+}
+
+/**
+ * Termina a receção do ficheiro de um CRE. Se o CRE falhar antes de o ficheiro chegar todo,
+ * a resposta é preparada de imediato mas só é enviada depois de descartado o resto do ficheiro,
+ * para que esses dados não sejam lidos como o pedido seguinte de uma conexão persistente.
+ */
+void conn_finish_body(Connection *conn, ServerState *server_data, bool body_ok, bool verbose) {
+    if (conn->body_discard) {
+        conn->body_discard = false;
+        conn->phase = CONN_WRITE_RESPONSE;
+    } else {
+        complete_create_request(conn, server_data, body_ok, verbose);
+        if (!body_ok && conn->body_remaining > 0) {
+            conn->body_discard = true;
+            conn->phase = CONN_READ_BODY;
+            return;
+        }
+    }
+    conn_response_ready(conn, server_data, verbose);
+}
+
+/**
+ * Recebe o ficheiro de um CRE com read/write (quando o splice não está disponível)
+ * ou descarta-o (CRE recusado)
+ */
+static IoResult conn_copy_body(Connection *conn, ServerState *server_data, bool verbose) {
+    char chunk[CONN_BODY_CHUNK];
+
+    while (conn->body_remaining > 0) {
+        size_t to_read = conn->body_remaining < (long)sizeof(chunk) ? (size_t)conn->body_remaining : sizeof(chunk);
+        ssize_t n = read(conn->fd, chunk, to_read);
+
+        if (n > 0) {
+            conn->body_remaining -= n;
+            if (conn->body_discard) continue;
+
+            ssize_t written = 0;
+            while (written < n) {
+                ssize_t w = pwrite(conn->body_fd, chunk + written, n - written, conn->body_offset);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    perror("Erro ao escrever ficheiro do evento no servidor");
+                    conn_finish_body(conn, server_data, false, verbose);
+                    return IO_NEXT;
+                }
+                written += w;
+                conn->body_offset += w;
+            }
+            STATS_ADD(&server_data->stats, cre_copy_bytes, n);
+            continue;
+        }
+
+        if (n == 0) {
+            if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected during upload.\n", conn->fd);
+            return IO_CLOSE;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return conn_flush(conn) == IO_CLOSE ? IO_CLOSE : IO_WAIT;
+        perror("Erro ao ler do socket TCP do cliente");
+        return IO_CLOSE;
+    }
+
+    conn_finish_body(conn, server_data, true, verbose);
+    return IO_NEXT;
+}
+
+/**
+ * Recebe o ficheiro de um CRE e escreve-o em disco à medida que chega, sem o copiar
+ * para o espaço do utilizador: splice do socket para um pipe e do pipe para o ficheiro.
+ */
+static IoResult conn_read_body(Connection *conn, ServerState *server_data, bool verbose) {
+    if (conn->body_copy || conn->body_discard || !conn_open_pipe(conn)) {
+        return conn_copy_body(conn, server_data, verbose);
+    }
+
+    while (conn->body_remaining > 0 || conn->pipe_len > 0) {
+        // esvaziar primeiro o pipe para o ficheiro, na posição seguinte do upload
+        if (conn->pipe_len > 0) {
+            ssize_t w = splice(conn->pipe_fds[0], NULL, conn->body_fd, &conn->body_offset, conn->pipe_len, SPLICE_F_MOVE);
+            if (w > 0) {
+                conn->pipe_len -= w;
+                STATS_ADD(&server_data->stats, cre_splice_bytes, w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            perror("Erro ao escrever ficheiro do evento no servidor");
+            conn_close_pipe(conn);
+            conn_finish_body(conn, server_data, false, verbose);
+            return IO_NEXT;
+        }
+
+        ssize_t n = splice(conn->fd, NULL, conn->pipe_fds[1], NULL, conn->body_remaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            conn->pipe_len = n;
+            conn->body_remaining -= n;
+            continue;
+        }
+
+        if (n == 0) {
+            if (verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected during upload.\n", conn->fd);
+            return IO_CLOSE;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return conn_flush(conn) == IO_CLOSE ? IO_CLOSE : IO_WAIT;
+        if (errno == EINVAL || errno == ENOSYS) {
+            // splice não suportado para este socket/ficheiro: continuar com read/write
+            conn->body_copy = true;
+            return conn_copy_body(conn, server_data, verbose);
+        }
+        perror("Erro ao ler do socket TCP do cliente");
+        return IO_CLOSE;
+    }
+
+    conn_finish_body(conn, server_data, true, verbose);
+    return IO_NEXT;
+}
+
+/**
+ * Envia parte do ficheiro através de um pipe: splice do ficheiro para o pipe e do pipe para o socket.
+ * Os dados que ficam no pipe quando o socket enche são enviados no evento seguinte.
+ */
+static ssize_t conn_splice_file(Connection *conn) {
+    if (!conn_open_pipe(conn)) return -1;
+
+    if (conn->pipe_len == 0) {
+        ssize_t in = splice(conn->file_fd, &conn->file_offset, conn->pipe_fds[1], NULL,
+                            conn->file_remaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in <= 0) return in;
+        conn->pipe_len = in;
+    }
+
+    ssize_t out = splice(conn->pipe_fds[0], NULL, conn->fd, NULL, conn->pipe_len,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+    if (out > 0) conn->pipe_len -= out;
+    return out;
+}
+
+/**
+ * Envia o ficheiro de descrição de um SED diretamente da cache de páginas para o socket.
+ * No modo FILE_SEND_COPY, lê apenas o bloco seguinte para a fila de saída, que é enviada pelo chamador.
+ */
+static IoResult conn_send_file(Connection *conn, ServerState *server_data) {
+    while (conn->file_remaining > 0) {
+        ssize_t n;
+
+        if (conn->send_mode == FILE_SEND_SENDFILE) {
+            n = sendfile(conn->fd, conn->file_fd, &conn->file_offset, conn->file_remaining);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                conn->send_mode = FILE_SEND_SPLICE;
+                continue;
+            }
+            if (n > 0) STATS_ADD(&server_data->stats, sed_sendfile_bytes, n);
+
+        } else if (conn->send_mode == FILE_SEND_SPLICE) {
+            n = conn_splice_file(conn);
+            if (n < 0 && conn->pipe_len == 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                conn->send_mode = FILE_SEND_COPY;
+                continue;
+            }
+            if (n > 0) STATS_ADD(&server_data->stats, sed_splice_bytes, n);
+
+        } else {
+            size_t to_read = conn->file_remaining < CONN_BODY_CHUNK ? (size_t)conn->file_remaining : CONN_BODY_CHUNK;
+            char *dst = out_queue_reserve(&conn->out, to_read);
+            if (dst == NULL) return IO_CLOSE;
+            n = pread(conn->file_fd, dst, to_read, conn->file_offset);
+            if (n > 0) {
+                STATS_ADD(&server_data->stats, sed_copy_bytes, n);
+                out_queue_commit(&conn->out, n);
+                conn->file_offset += n;
+                conn->file_remaining -= n;
+                return IO_NEXT;
+            }
+        }
+
+        if (n > 0) {
+            conn->file_remaining -= n;
+            continue;
+        }
+        if (n == 0) {
+            fprintf(stderr, "Erro ao ler ficheiro de descrição: fim de ficheiro inesperado\n");
+            return IO_CLOSE;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IO_WAIT;
+        perror("Erro ao enviar ficheiro de descrição");
+        return IO_CLOSE;
+    }
+    return IO_NEXT;
+}
+
+/**
+ * Envia o ficheiro de descrição de um SED, depois das respostas em fila e do cabeçalho
+ */
+static IoResult conn_write_file(Connection *conn, ServerState *server_data, bool verbose) {
+    // o cabeçalho, o ficheiro e o '\n' final são agrupados em segmentos cheios
+    if (!conn->corked) {
+        conn_set_cork(conn, true);
+    }
+
+    while (1) {
+        IoResult result = conn_flush(conn);
+        if (result != IO_NEXT) return result;
+
+        if (conn->file_remaining == 0) {
+            conn_file_sent(conn, server_data, verbose);
+            return IO_NEXT;
+        }
+
+        result = conn_send_file(conn, server_data);
+        if (result != IO_NEXT) return result;
+    }
+}
+
+/**
+ * Avança a máquina de estados da conexão até esta ficar à espera do socket.
+ * Devolve false quando a conexão deve ser fechada.
+ */
+bool conn_handle_io(Connection *conn, ServerState *server_data, bool verbose) {
+    while (1) {
+        IoResult result;
+
+        switch (conn->phase) {
+            case CONN_READ_REQUEST:
+                result = conn_read_request(conn, server_data, verbose);
+                break;
+            case CONN_READ_BODY:
+                result = conn_read_body(conn, server_data, verbose);
+                break;
+            case CONN_SEND_FILE:
+                result = conn_write_file(conn, server_data, verbose);
+                break;
+            case CONN_WRITE_RESPONSE:
+                result = conn_flush(conn);
+                if (result == IO_NEXT) conn->phase = CONN_DONE;
+                break;
+            case CONN_DONE:
+            default:
+                return false;
+        }
+
+        if (result == IO_WAIT) return true;
+        if (result == IO_CLOSE) return false;
+    }
+}
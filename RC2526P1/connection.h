@@ -0,0 +1,191 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "structures.h"
+#include <stdbool.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <time.h>
+
+// Tamanho máximo do cabeçalho de um pedido TCP
+#define CONN_REQUEST_MAX 1024
+
+// Tamanho máximo da resposta a um pedido (construída em out_buf antes de entrar na fila de saída)
+#define CONN_RESPONSE_MAX 8192
+
+// Limites da fila de saída: acima de HIGH deixa-se de ler pedidos do cliente até a fila descer a LOW
+#define CONN_OUT_HIGH_WATERMARK (256 * 1024)
+#define CONN_OUT_LOW_WATERMARK (64 * 1024)
+
+// Tamanho dos blocos lidos do socket durante o upload de um ficheiro
+#define CONN_BODY_CHUNK 65536
+
+// Capacidade pedida para o pipe usado pelo splice (o kernel pode limitá-la)
+#define CONN_PIPE_SIZE (1024 * 1024)
+
+/*
+ * Fases do processamento de um pedido TCP.
+ * - CONN_READ_REQUEST: a acumular o cabeçalho do pedido (e a enviar as respostas em fila).
+ * - CONN_READ_BODY: a receber o ficheiro de um CRE e a escrevê-lo em disco.
+ * - CONN_WRITE_RESPONSE: último pedido respondido, a esvaziar a fila de saída antes de fechar.
+ * - CONN_SEND_FILE: a enviar o ficheiro de descrição de um SED.
+ * - CONN_DONE: a conexão pode ser fechada.
+ * Depois de cada resposta, uma conexão persistente (KAL) volta a CONN_READ_REQUEST
+ * sem esperar que a resposta seja enviada.
+ */
+typedef enum {
+    CONN_READ_REQUEST,
+    CONN_READ_BODY,
+    CONN_WRITE_RESPONSE,
+    CONN_SEND_FILE,
+    CONN_DONE
+} ConnPhase;
+
+/*
+ * Forma de envio do ficheiro de descrição de um SED. Começa por sendfile e, se o
+ * kernel não o suportar para estes descritores, passa a splice e por fim a read/write.
+ */
+typedef enum {
+    FILE_SEND_SENDFILE,
+    FILE_SEND_SPLICE,
+    FILE_SEND_COPY
+} FileSendMode;
+
+/*
+ * Fila de saída de uma conexão: bytes por enviar entre off e len, num buffer que cresce
+ * conforme necessário (respostas de pedidos em pipeline acumulam-se aqui).
+ */
+typedef struct OutQueue {
+    char *data;
+    size_t off;
+    size_t len;
+    size_t cap;
+} OutQueue;
+
+/*
+ * Dados de um CRE cujo ficheiro ainda está a ser recebido.
+ */
+typedef struct PendingCreate {
+    int eid;
+    char uid[7];
+    char name[11];
+    char fname[25];
+    char full_date[17];
+    int attendance_size;
+    char file_path[128];
+} PendingCreate;
+
+/*
+ * Estado de uma conexão TCP ativa com um cliente.
+ */
+typedef struct Connection {
+    int fd;
+    struct sockaddr_in addr;
+    ConnPhase phase;
+
+    // cabeçalho do pedido (terminado em '\0')
+    char in_buf[CONN_REQUEST_MAX + 1];
+    size_t in_len;
+
+    // upload do ficheiro de um CRE (socket -> pipe -> ficheiro com splice)
+    int body_fd;
+    long body_remaining;
+    bool body_copy;         // splice não suportado: receber com read/write
+    bool body_discard;      // CRE já recusado: descartar o ficheiro que ainda está a chegar
+    PendingCreate create;
+
+    // resposta ao pedido atual, e fila com as respostas por enviar
+    char out_buf[CONN_RESPONSE_MAX];
+    OutQueue out;
+    bool throttled;         // fila acima do limite: não ler mais pedidos até esvaziar
+    bool response_queued;   // a resposta ao pedido atual já foi colocada na fila (CRE concluído no próprio pedido)
+
+    // download do ficheiro de um SED (sem cópias para o espaço do utilizador, exceto no modo FILE_SEND_COPY)
+    int file_fd;
+    off_t file_remaining;
+    FileSendMode send_mode;
+    int pipe_fds[2];        // pipe intermédio do splice (criado só quando necessário)
+    size_t pipe_len;        // bytes que estão no pipe à espera do destino (socket ou ficheiro)
+    bool corked;            // TCP_CORK ativo: cabeçalho, ficheiro e '\n' saem em segmentos cheios
+
+    // backend io_uring: operação em curso e posições nos ficheiros (as escritas/leituras usam offsets)
+    int uring_op;
+    char *body_chunk;
+    size_t chunk_len;
+    size_t chunk_off;
+    off_t body_offset;
+    off_t file_offset;
+
+    // conexão persistente (KAL): pedidos já servidos e bytes de in_buf usados pelo pedido atual
+    bool keep_alive;
+    int requests_served;
+    size_t in_consumed;
+
+    // inatividade: instante da última atividade e posição na lista de conexões da tabela
+    time_t last_active;
+    bool idle_expired;
+    struct Connection *idle_prev;
+    struct Connection *idle_next;
+} Connection;
+
+/*
+ * Tabela de conexões TCP indexada pelo descritor de ficheiro.
+ * Cresce conforme necessário, não havendo limite fixo de clientes.
+ * As conexões são também mantidas numa lista ordenada pela última atividade,
+ * para que as inativas sejam encontradas sem percorrer a tabela toda.
+ */
+typedef struct ConnTable {
+    Connection **slots;
+    int capacity;
+    int count;
+    Connection *idle_head;  // conexão inativa há mais tempo
+    Connection *idle_tail;
+} ConnTable;
+
+// Fila de saída
+size_t out_queue_pending(const OutQueue *queue);
+char *out_queue_reserve(OutQueue *queue, size_t size);
+void out_queue_commit(OutQueue *queue, size_t size);
+void out_queue_consume(OutQueue *queue, size_t size);
+void out_queue_free(OutQueue *queue);
+
+void conn_table_init(ConnTable *table);
+Connection *conn_table_add(ConnTable *table, int fd, const struct sockaddr_in *addr);
+Connection *conn_table_get(ConnTable *table, int fd);
+void conn_table_remove(ConnTable *table, int fd);
+void conn_table_destroy(ConnTable *table);
+
+// Regista atividade numa conexão (passa para o fim da lista de inatividade)
+void conn_table_touch(ConnTable *table, Connection *conn);
+
+// Devolve a conexão inativa há mais tempo se tiver excedido idle_timeout segundos (ou NULL)
+Connection *conn_table_next_expired(ConnTable *table, int idle_timeout);
+
+// Retira uma conexão da lista de inatividade (não volta a expirar)
+void conn_table_untrack(ConnTable *table, Connection *conn);
+
+// Indica se in_buf já contém o cabeçalho completo de um pedido
+bool conn_request_ready(Connection *conn);
+
+// Termina a receção do ficheiro de um CRE, preparando a resposta
+void conn_finish_body(Connection *conn, ServerState *server_data, bool body_ok, bool verbose);
+
+// Acrescenta bytes à fila de saída da conexão; devolve false se não houver memória
+bool conn_enqueue(Connection *conn, ServerState *server_data, const char *data, size_t len);
+
+// Coloca a resposta em out_buf na fila e passa ao pedido seguinte (ou a fechar a conexão)
+void conn_response_ready(Connection *conn, ServerState *server_data, bool verbose);
+
+// Termina o envio do ficheiro de um SED (o '\n' final segue na fila de saída)
+void conn_file_sent(Connection *conn, ServerState *server_data, bool verbose);
+
+// Aplica os limites da fila de saída; devolve true enquanto não se devem ler pedidos do cliente
+bool conn_output_throttled(Connection *conn, ServerState *server_data, bool verbose);
+
+// Processa o cabeçalho completo de um pedido, preparando a fase seguinte da conexão
+void conn_dispatch_request(Connection *conn, ServerState *server_data, bool verbose);
+
+// Avança a máquina de estados da conexão; devolve false quando esta deve ser fechada
+bool conn_handle_io(Connection *conn, ServerState *server_data, bool verbose);
+
+#endif
@@ -1,234 +1,589 @@
 #include "data_manager.h"
+#include "utils.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #include <time.h>
-#include <dirent.h>
+#include <pthread.h>
 
 void handle_error(const char *msg) {
     perror(msg);
     exit(1);
 }
 
+// Motor de armazenamento escolhido no arranque (por omissão, a estrutura original de ficheiros)
+static const StorageEngine *storage = &files_storage;
+
+/**
+ * Escolhe e prepara o motor de armazenamento ("files" ou "log").
+ * Devolve false se o nome não for conhecido ou se o armazenamento não puder ser aberto.
+ */
+bool storage_open(const char *engine_name, ServerStats *stats, bool verbose) {
+    if (strcmp(engine_name, files_storage.name) == 0) {
+        storage = &files_storage;
+    } else if (strcmp(engine_name, log_storage.name) == 0) {
+        storage = &log_storage;
+    } else {
+        return false;
+    }
+    return storage->open(stats, verbose);
+}
+
+/**
+ * Fecha o motor de armazenamento (o log garante que todos os registos ficam em disco)
+ */
+void storage_close(void) {
+    storage->close();
+}
+
+// Capacidade inicial da tabela de utilizadores (potência de 2)
+#define USER_TABLE_INITIAL_CAPACITY 1024
+
+/*
+ * Cópia em memória do estado guardado de um utilizador (em USERS/<uid> no motor de ficheiros).
+ * O utilizador mantém-se depois de um UNR (com o registo das reservas e eventos criados),
+ * pelo que pode existir sem estar registado.
+ */
+typedef struct UserRecord {
+    int uid;                // -1 numa posição livre da tabela
+    bool has_dir;           // o utilizador já se registou alguma vez (USERS/<uid> existe)
+    bool registered;        // tem password (<uid>_pass.txt existe)
+    bool logged_in;         // tem sessão iniciada (<uid>_login.txt existe)
+    char password[9];
+} UserRecord;
+
+/*
+ * Tabela de dispersão (endereçamento aberto, sondagem linear) indexada pelo UID.
+ * As consultas são servidas da memória; as alterações são escritas primeiro em disco
+ * e só depois refletidas na tabela. Os utilizadores nunca são removidos da tabela.
+ */
+typedef struct UserTable {
+    UserRecord *slots;
+    size_t capacity;
+    size_t count;
+    pthread_rwlock_t lock;
+} UserTable;
+
+static UserTable users = { NULL, 0, 0, PTHREAD_RWLOCK_INITIALIZER };
+
 /**
- * Verifica se um utilizador existe, procurando pela sua diretoria
+ * Converte um UID de 6 dígitos na chave da tabela (-1 se o formato for inválido)
+ */
+static int user_key(const char *uid) {
+    int key = 0;
+    for (int i = 0; i < 6; i++) {
+        if (uid[i] < '0' || uid[i] > '9') return -1;
+        key = key * 10 + (uid[i] - '0');
+    }
+    return uid[6] == '\0' ? key : -1;
+}
+
+static size_t user_hash(int key, size_t capacity) {
+    // constante de Knuth: espalha UIDs consecutivos pela tabela
+    return ((unsigned)key * 2654435761u) & (capacity - 1);
+}
+
+/**
+ * Procura um utilizador na tabela (com o lock já adquirido)
+ */
+static UserRecord *user_find(int key) {
+    if (key < 0 || users.capacity == 0) return NULL;
+    for (size_t i = user_hash(key, users.capacity); ; i = (i + 1) & (users.capacity - 1)) {
+        if (users.slots[i].uid == key) return &users.slots[i];
+        if (users.slots[i].uid == -1) return NULL;
+    }
+}
+
+/**
+ * Duplica a capacidade da tabela, voltando a inserir todos os utilizadores
+ */
+static bool user_table_grow(void) {
+    size_t new_capacity = users.capacity > 0 ? users.capacity * 2 : USER_TABLE_INITIAL_CAPACITY;
+    UserRecord *new_slots = malloc(new_capacity * sizeof(UserRecord));
+    if (new_slots == NULL) return false;
+    for (size_t i = 0; i < new_capacity; i++) {
+        new_slots[i].uid = -1;
+    }
+
+    for (size_t i = 0; i < users.capacity; i++) {
+        if (users.slots[i].uid == -1) continue;
+        size_t j = user_hash(users.slots[i].uid, new_capacity);
+        while (new_slots[j].uid != -1) {
+            j = (j + 1) & (new_capacity - 1);
+        }
+        new_slots[j] = users.slots[i];
+    }
+
+    free(users.slots);
+    users.slots = new_slots;
+    users.capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Devolve o registo de um utilizador, criando-o se ainda não existir (com o lock de escrita adquirido)
+ */
+static UserRecord *user_find_or_insert(int key) {
+    if (key < 0) return NULL;
+    UserRecord *record = user_find(key);
+    if (record != NULL) return record;
+
+    // manter a ocupação abaixo de 70% para que as sondagens sejam curtas
+    if ((users.count + 1) * 10 > users.capacity * 7 && !user_table_grow()) {
+        return NULL;
+    }
+    size_t i = user_hash(key, users.capacity);
+    while (users.slots[i].uid != -1) {
+        i = (i + 1) & (users.capacity - 1);
+    }
+    record = &users.slots[i];
+    memset(record, 0, sizeof(*record));
+    record->uid = key;
+    users.count++;
+    return record;
+}
+
+/**
+ * Acrescenta à tabela um utilizador lido pelo motor de armazenamento no arranque
+ */
+static void load_user(const char *uid, bool registered, bool logged_in, const char *password) {
+    UserRecord *record = user_find_or_insert(user_key(uid));
+    if (record == NULL) return;
+    record->has_dir = true;
+    record->registered = registered;
+    record->logged_in = logged_in;
+    snprintf(record->password, sizeof(record->password), "%s", password);
+}
+
+/**
+ * Carrega para memória todos os utilizadores guardados.
+ * Devolve o número de utilizadores carregados (ou -1 se o armazenamento não puder ser lido).
+ */
+int load_users(void) {
+    pthread_rwlock_wrlock(&users.lock);
+    int loaded = storage->load_users(load_user);
+    pthread_rwlock_unlock(&users.lock);
+    return loaded;
+}
+
+/**
+ * Verifica se um utilizador existe (se tem diretoria em USERS/)
  */
 bool user_exists(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s", uid);
-    struct stat st;
-    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    pthread_rwlock_rdlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    bool result = record != NULL && record->has_dir;
+    pthread_rwlock_unlock(&users.lock);
+    return result;
 }
 
 /**
- * Verifica se o ficheiro de password de um utilizador existe
+ * Verifica se o ficheiro de password de um utilizador existe (se está registado)
  */
 bool user_password_file_exists(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
-    struct stat st;
-    return stat(path, &st) == 0;
+    pthread_rwlock_rdlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    bool result = record != NULL && record->registered;
+    pthread_rwlock_unlock(&users.lock);
+    return result;
 }
 
 /**
- * Verifica se a password fornecida corresponde à guardada no ficheiro do utilizador
+ * Verifica se a password fornecida corresponde à guardada para o utilizador
  */
 bool check_user_password(const char *uid, const char *password) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
-    FILE *f = fopen(path, "r");
-    if (f == NULL) return false;
-
-    char stored_password[10]; // 8 chars + \n + \0
-    bool result = false;
-    if (fgets(stored_password, sizeof(stored_password), f) != NULL) {
-        stored_password[strcspn(stored_password, "\n")] = 0;
-        if (strcmp(stored_password, password) == 0) {
-            result = true;
-        }
-    }
-    fclose(f);
+    pthread_rwlock_rdlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    bool result = record != NULL && record->registered && strcmp(record->password, password) == 0;
+    pthread_rwlock_unlock(&users.lock);
     return result;
 }
 
 /**
- * Verifica se um utilizador está logado, procurando pelo ficheiro _login.txt
+ * Verifica se um utilizador tem sessão iniciada
  */
 bool is_user_logged_in(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_login.txt", uid, uid);
-    struct stat st;
-    return stat(path, &st) == 0;
+    pthread_rwlock_rdlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    bool result = record != NULL && record->logged_in;
+    pthread_rwlock_unlock(&users.lock);
+    return result;
 }
 
 /**
- * Cria a estrutura de ficheiros para um novo utilizador
+ * Regista um novo utilizador (ou volta a registar um que tinha feito UNR)
  */
 void create_user_files(const char *uid, const char *password) {
-    char path[256];
+    bool written = storage->create_user(uid, password);
 
-    // diretoria USERS/<uid>
-    snprintf(path, sizeof(path), "USERS/%s", uid);
-    mkdir(path, 0700);
-
-    // subdiretorias CREATED e RESERVED
-    snprintf(path, sizeof(path), "USERS/%s/CREATED", uid);
-    mkdir(path, 0700);
-    snprintf(path, sizeof(path), "USERS/%s/RESERVED", uid);
-    mkdir(path, 0700);
-
-    // ficheiro USERS/<uid>/<uid>_pass.txt
-    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
-    FILE *f = fopen(path, "w");
-    if (f != NULL) {
-        fprintf(f, "%s\n", password);
-        fclose(f);
+    pthread_rwlock_wrlock(&users.lock);
+    UserRecord *record = user_find_or_insert(user_key(uid));
+    if (record != NULL) {
+        record->has_dir = true;
+        record->registered = written;
+        snprintf(record->password, sizeof(record->password), "%s", password);
     }
+    pthread_rwlock_unlock(&users.lock);
 }
 
 /**
- * Cria o ficheiro de sessão para um utilizador
+ * Inicia a sessão de um utilizador
  */
 void create_login_file(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_login.txt", uid, uid);
-    FILE *f = fopen(path, "w");
-    if (f != NULL) {
-        fclose(f);
-    }
+    if (!storage->set_login(uid, true)) return;
+
+    pthread_rwlock_wrlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    if (record != NULL) record->logged_in = true;
+    pthread_rwlock_unlock(&users.lock);
 }
 
 /**
- * Remove o ficheiro de sessão de um utilizador
+ * Termina a sessão de um utilizador
  */
 void remove_login_file(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_login.txt", uid, uid);
-    unlink(path);
+    storage->set_login(uid, false);
+
+    pthread_rwlock_wrlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    if (record != NULL) record->logged_in = false;
+    pthread_rwlock_unlock(&users.lock);
 }
 
 /**
- * Atualiza a password de um utilizador no seu ficheiro _pass.txt
+ * Atualiza a password de um utilizador
  */
 bool update_user_password(const char *uid, const char *new_password) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
-    FILE *f = fopen(path, "w"); // Abre em modo de escrita, sobrescrevendo o conteúdo
-    if (f == NULL) return false;
+    if (!storage->set_password(uid, new_password)) return false;
 
-    fprintf(f, "%s\n", new_password);
-    fclose(f);
+    pthread_rwlock_wrlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    if (record != NULL) snprintf(record->password, sizeof(record->password), "%s", new_password);
+    pthread_rwlock_unlock(&users.lock);
     return true;
 }
 
 /**
- * Remove os ficheiros de um utilizador
+ * Remove o registo de um utilizador (password e sessão)
  */
 void remove_user_files(const char *uid) {
-    char path[256];
-    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
-    unlink(path);
-    remove_login_file(uid);
+    storage->remove_user(uid);
+
+    pthread_rwlock_wrlock(&users.lock);
+    UserRecord *record = user_find(user_key(uid));
+    if (record != NULL) {
+        record->registered = false;
+        record->logged_in = false;
+        memset(record->password, 0, sizeof(record->password));
+    }
+    pthread_rwlock_unlock(&users.lock);
 }
 
 /**
- * Obtém a data e hora atuais e formata-as para serem usadas em nomes de ficheiros
- * date_str: YYYYMMDD
- * time_str: HHMMSS
+ * Percorre as reservas de um utilizador, da mais recente para a mais antiga, até visit devolver false
  */
-void get_datetime_for_filename(char *date_str, char *time_str, size_t size) {
-    time_t now;
-    struct tm *ts;
+int for_each_user_reservation(const char *uid, ReservationVisitor visit, void *ctx) {
+    return storage->list_reservations(uid, visit, ctx);
+}
 
-    time(&now);
-    ts = localtime(&now);
+// Capacidade inicial da tabela de eventos (indexada diretamente pelo EID)
+#define EVENT_TABLE_INITIAL_CAPACITY 1024
+
+/*
+ * Entrada do heap de tempos: o evento eid passa a PAST depois de when.
+ */
+typedef struct EventTimer {
+    time_t when;
+    int eid;
+} EventTimer;
 
-    // Formato YYYY-MM-DD
-    strftime(date_str, size, "%Y%m%d", ts);
-    // Formato HHMMSS
-    strftime(time_str, size, "%H%M%S", ts);
+/*
+ * Tabela de eventos: posição eid do vetor slots (eid 0 = posição livre).
+ * O heap de mínimos guarda os eventos ainda por acontecer, ordenados pela data;
+ * qualquer consulta compara a data mais próxima com a hora atual e, se esta já passou,
+ * marca como PAST os eventos expirados e guarda o fim de cada um (END_<eid>.txt nos ficheiros).
+ */
+typedef struct EventTable {
+    Event *slots;
+    int capacity;
+    int count;
+    EventTimer *heap;
+    int heap_len;
+    int heap_cap;
+    pthread_rwlock_t lock;
+} EventTable;
+
+static EventTable events = { NULL, 0, 0, NULL, 0, 0, PTHREAD_RWLOCK_INITIALIZER };
+
+/**
+ * Troca duas entradas do heap
+ */
+static void event_heap_swap(int a, int b) {
+    EventTimer tmp = events.heap[a];
+    events.heap[a] = events.heap[b];
+    events.heap[b] = tmp;
 }
 
 /**
- * Cria o ficheiro END_<eid>.txt para marcar um evento como fechado
- * O ficheiro contém a data e hora de encerramento
+ * Acrescenta um evento ao heap de tempos (com o lock de escrita adquirido)
  */
-void create_end_file(const char *eid_str) {
-    char path[256];
-    snprintf(path, sizeof(path), "EVENTS/%s/END_%s.txt", eid_str, eid_str);
-    FILE *f = fopen(path, "w");
-    if (f != NULL) {
-        time_t now;
-        struct tm *ts;
-        char datetime_str[20]; // dd-mm-yyyy HH:MM:SS
+static bool event_heap_push(time_t when, int eid) {
+    if (events.heap_len == events.heap_cap) {
+        int new_cap = events.heap_cap > 0 ? events.heap_cap * 2 : EVENT_TABLE_INITIAL_CAPACITY;
+        EventTimer *new_heap = realloc(events.heap, new_cap * sizeof(EventTimer));
+        if (new_heap == NULL) return false;
+        events.heap = new_heap;
+        events.heap_cap = new_cap;
+    }
 
-        time(&now);
-        ts = localtime(&now);
-        strftime(datetime_str, sizeof(datetime_str), "%d-%m-%Y %H:%M:%S", ts);
-        fprintf(f, "%s\n", datetime_str);
-        fclose(f);
+    int i = events.heap_len++;
+    events.heap[i].when = when;
+    events.heap[i].eid = eid;
+    while (i > 0 && events.heap[(i - 1) / 2].when > events.heap[i].when) {
+        event_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
     }
+    return true;
 }
 
 /**
- * Calcula o estado atual de um evento com base nos ficheiros e na data
+ * Retira do heap o evento com a data mais próxima (com o lock de escrita adquirido)
  */
-EventState get_event_state(const char *eid_str) {
-    char path[256];
+static EventTimer event_heap_pop(void) {
+    EventTimer top = events.heap[0];
+    events.heap[0] = events.heap[--events.heap_len];
 
-    // verificar se o evento está fechado (END_.txt existe)
-    snprintf(path, sizeof(path), "EVENTS/%s/END_%s.txt", eid_str, eid_str);
-    struct stat st;
-    if (stat(path, &st) == 0) {
-        return CLOSED;
+    int i = 0;
+    while (1) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < events.heap_len && events.heap[left].when < events.heap[smallest].when) smallest = left;
+        if (right < events.heap_len && events.heap[right].when < events.heap[smallest].when) smallest = right;
+        if (smallest == i) break;
+        event_heap_swap(i, smallest);
+        i = smallest;
     }
+    return top;
+}
 
-    // ler os detalhes do evento para verificar data e lotação
-    char start_path[256];
-    snprintf(start_path, sizeof(start_path), "EVENTS/%s/START_%s.txt", eid_str, eid_str);
-    FILE *start_file = fopen(start_path, "r");
-    if (!start_file) {
-        return -1;
+/**
+ * Marca como PAST os eventos cuja data já passou. No caso comum (nenhum evento expirou)
+ * custa apenas uma comparação com o topo do heap.
+ */
+static void expire_past_events(void) {
+    time_t now = time(NULL);
+
+    pthread_rwlock_rdlock(&events.lock);
+    bool expired = events.heap_len > 0 && events.heap[0].when < now;
+    pthread_rwlock_unlock(&events.lock);
+    if (!expired) return;
+
+    int *ended = NULL;
+    int ended_count = 0;
+
+    pthread_rwlock_wrlock(&events.lock);
+    // outro worker pode já ter tratado estes eventos entretanto
+    while (events.heap_len > 0 && events.heap[0].when < now) {
+        EventTimer timer = event_heap_pop();
+        Event *event = &events.slots[timer.eid];
+        if (event->state == CLOSED || event->state == PAST) continue;
+        event->state = PAST;
+
+        int *new_ended = realloc(ended, (ended_count + 1) * sizeof(int));
+        if (new_ended == NULL) continue;
+        ended = new_ended;
+        ended[ended_count++] = timer.eid;
     }
+    pthread_rwlock_unlock(&events.lock);
 
-    char date_str[11], time_str[6];
-    int total_seats;
-    fscanf(start_file, "%*s %*s %*s %d %10s %5s", &total_seats, date_str, time_str);
-    fclose(start_file);
+    // o fim dos eventos é guardado fora do lock, para não bloquear as consultas
+    for (int i = 0; i < ended_count; i++) {
+        storage->end_event(ended[i], PAST);
+    }
+    free(ended);
+}
 
-    // verificar se o evento já passou
-    struct tm event_tm = {0};
-    sscanf(date_str, "%d-%d-%d", &event_tm.tm_mday, &event_tm.tm_mon, &event_tm.tm_year);
-    sscanf(time_str, "%d:%d", &event_tm.tm_hour, &event_tm.tm_min);
-    event_tm.tm_mon -= 1;
-    event_tm.tm_year -= 1900;
-    event_tm.tm_isdst = -1;
+/**
+ * Garante que a tabela tem uma posição para o evento eid (com o lock de escrita adquirido)
+ */
+static bool event_table_reserve(int eid) {
+    if (eid < events.capacity) return true;
 
-    time_t event_time = mktime(&event_tm);
-    time_t now = time(NULL);
+    int new_capacity = events.capacity > 0 ? events.capacity : EVENT_TABLE_INITIAL_CAPACITY;
+    while (new_capacity <= eid) {
+        new_capacity *= 2;
+    }
+    Event *new_slots = realloc(events.slots, new_capacity * sizeof(Event));
+    if (new_slots == NULL) return false;
+    memset(new_slots + events.capacity, 0, (new_capacity - events.capacity) * sizeof(Event));
+    events.slots = new_slots;
+    events.capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Insere um evento na tabela e, se ainda não tiver terminado, no heap de tempos
+ */
+static bool event_table_insert(const Event *event) {
+    pthread_rwlock_wrlock(&events.lock);
+    bool ok = event_table_reserve(event->eid);
+    if (ok) {
+        if (event->state != CLOSED && event->state != PAST) {
+            ok = event_heap_push(event->event_time, event->eid);
+        }
+        if (ok) {
+            if (events.slots[event->eid].eid == 0) events.count++;
+            events.slots[event->eid] = *event;
+        }
+    }
+    pthread_rwlock_unlock(&events.lock);
+    return ok;
+}
+
+/**
+ * Carrega para memória todos os eventos guardados.
+ * Devolve o número de eventos carregados (ou -1 se o armazenamento não puder ser lido).
+ */
+int load_events(void) {
+    int loaded = storage->load_events(event_table_insert);
+
+    // os eventos cuja data passou com o servidor parado terminam já aqui
+    expire_past_events();
+    return loaded;
+}
+
+/**
+ * Devolve o próximo EID guardado (1 se ainda não foi criado nenhum evento)
+ */
+int load_next_eid(void) {
+    return storage->load_next_eid();
+}
+
+/**
+ * Guarda o contador de EIDs, para que os EIDs atribuídos não sejam reutilizados depois de reiniciar
+ */
+bool save_next_eid(int next_eid) {
+    return storage->save_next_eid(next_eid);
+}
+
+/**
+ * Guarda um evento cujo ficheiro de descrição já foi recebido e regista-o na tabela
+ */
+bool add_event(int eid, const char *owner_uid, const char *name, const char *filename, const char *date, int total_seats) {
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.eid = eid;
+    snprintf(event.owner_uid, sizeof(event.owner_uid), "%s", owner_uid);
+    snprintf(event.name, sizeof(event.name), "%s", name);
+    snprintf(event.filename, sizeof(event.filename), "%s", filename);
+    snprintf(event.date, sizeof(event.date), "%s", date);
+    event.event_time = datetime_to_epoch(date);
+    event.total_seats = total_seats;
+    event.reserved_seats = 0;
+    event.state = ACTIVE;
+    return storage->create_event(&event) && event_table_insert(&event);
+}
 
-    if (difftime(now, event_time) > 0) {
-        create_end_file(eid_str);
-        return PAST;
+/**
+ * Copia os dados de um evento para event_out. Devolve false se o evento não existir.
+ */
+bool get_event(int eid, Event *event_out) {
+    expire_past_events();
+
+    pthread_rwlock_rdlock(&events.lock);
+    bool found = eid > 0 && eid < events.capacity && events.slots[eid].eid == eid;
+    if (found) *event_out = events.slots[eid];
+    pthread_rwlock_unlock(&events.lock);
+    return found;
+}
+
+/**
+ * Devolve o estado atual de um evento (ou -1 se o evento não existir)
+ */
+EventState get_event_state(int eid) {
+    Event event;
+    if (!get_event(eid, &event)) return -1;
+    return event.state;
+}
+
+/**
+ * Percorre os eventos por ordem crescente de EID, até visit devolver false
+ */
+void for_each_event(EventVisitor visit, void *ctx) {
+    expire_past_events();
+
+    pthread_rwlock_rdlock(&events.lock);
+    for (int eid = 1; eid < events.capacity; eid++) {
+        if (events.slots[eid].eid != eid) continue;
+        if (!visit(&events.slots[eid], ctx)) break;
     }
+    pthread_rwlock_unlock(&events.lock);
+}
+
+/**
+ * Número de eventos na tabela
+ */
+int event_count(void) {
+    pthread_rwlock_rdlock(&events.lock);
+    int count = events.count;
+    pthread_rwlock_unlock(&events.lock);
+    return count;
+}
+
+/**
+ * Guarda uma reserva de seats lugares e atualiza o número de lugares reservados do evento.
+ * O chamador garante a exclusão mútua da leitura-modificação-escrita (reservation_lock).
+ */
+bool record_reservation(int eid, const char *uid, int seats, int reserved_seats) {
+    Reservation reservation;
+    reservation.eid = eid;
+    snprintf(reservation.uid, sizeof(reservation.uid), "%s", uid);
+    reservation.seats = seats;
+    format_current_datetime(reservation.datetime, sizeof(reservation.datetime));
+    if (!storage->add_reservation(&reservation, reserved_seats)) return false;
 
-    // verificar se o evento está esgotado
-    char res_path[256];
-    snprintf(res_path, sizeof(res_path), "EVENTS/%s/RES_%s.txt", eid_str, eid_str);
-    FILE *res_file = fopen(res_path, "r");
-    if (!res_file) {
-        return -1;
+    pthread_rwlock_wrlock(&events.lock);
+    if (eid > 0 && eid < events.capacity && events.slots[eid].eid == eid) {
+        Event *event = &events.slots[eid];
+        event->reserved_seats = reserved_seats;
+        if (event->state == ACTIVE || event->state == SOLD_OUT) {
+            event->state = reserved_seats >= event->total_seats ? SOLD_OUT : ACTIVE;
+        }
     }
-    int reserved_seats = 0;
-    fscanf(res_file, "%d", &reserved_seats);
-    fclose(res_file);
+    pthread_rwlock_unlock(&events.lock);
+    return true;
+}
+
+/**
+ * Fecha um evento: guarda o fim (END_<eid>.txt nos ficheiros) e marca-o como CLOSED
+ */
+bool close_event(int eid) {
+    if (!storage->end_event(eid, CLOSED)) return false;
 
-    if (reserved_seats >= total_seats) {
-        return SOLD_OUT;
+    pthread_rwlock_wrlock(&events.lock);
+    if (eid > 0 && eid < events.capacity && events.slots[eid].eid == eid) {
+        events.slots[eid].state = CLOSED;
     }
+    pthread_rwlock_unlock(&events.lock);
+    return true;
+}
 
-    // se nada acima se aplicar, o evento está ativo
-    return ACTIVE;
+/**
+ * Prepara o ficheiro de descrição de um evento a criar e devolve o seu caminho em path
+ */
+bool prepare_event_description(int eid, const char *filename, char *path, size_t size) {
+    return storage->prepare_description(eid, filename, path, size);
+}
+
+/**
+ * Remove o ficheiro de descrição de um evento cujo upload falhou
+ */
+void discard_event_description(int eid, const char *filename) {
+    storage->discard_description(eid, filename);
+}
+
+/**
+ * Caminho do ficheiro de descrição de um evento
+ */
+void event_description_path(int eid, const char *filename, char *path, size_t size) {
+    storage->description_path(eid, filename, path, size);
 }
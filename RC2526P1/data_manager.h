@@ -2,12 +2,18 @@
 #define DATA_MANAGER_H
 
 #include "structures.h"
+#include "storage.h"
 #include <stddef.h>
 
 // Função de utilidade para tratamento de erros
 void handle_error(const char *msg);
 
-// Funções de gestão de users baseadas em ficheiros
+// Escolha do motor de armazenamento ("files" ou "log"), antes de carregar o estado
+bool storage_open(const char *engine_name, ServerStats *stats, bool verbose);
+void storage_close(void);
+
+// Funções de gestão de users: consultas servidas da memória, alterações escritas também em disco
+int load_users(void);
 bool user_exists(const char *uid);
 bool user_password_file_exists(const char *uid);
 bool check_user_password(const char *uid, const char *password);
@@ -17,12 +23,25 @@ void create_login_file(const char *uid);
 void remove_login_file(const char *uid);
 bool update_user_password(const char *uid, const char *new_password);
 void remove_user_files(const char *uid);
+int for_each_user_reservation(const char *uid, ReservationVisitor visit, void *ctx);
+
+// Funções de gestão de eventos: estado mantido em memória, alterações escritas também em disco
+typedef bool (*EventVisitor)(const Event *event, void *ctx);
 
-// Funções de utilidade para datas
-void get_datetime_for_filename(char *date_str, char *time_str, size_t size);
+int load_events(void);
+int load_next_eid(void);
+bool save_next_eid(int next_eid);
+bool add_event(int eid, const char *owner_uid, const char *name, const char *filename, const char *date, int total_seats);
+bool get_event(int eid, Event *event_out);
+EventState get_event_state(int eid);
+void for_each_event(EventVisitor visit, void *ctx);
+int event_count(void);
+bool record_reservation(int eid, const char *uid, int seats, int reserved_seats);
+bool close_event(int eid);
 
-// Funções de gestão de eventos
-void create_end_file(const char *eid_str);
-EventState get_event_state(const char *eid_str);
+// Ficheiros de descrição dos eventos
+bool prepare_event_description(int eid, const char *filename, char *path, size_t size);
+void discard_event_description(int eid, const char *filename);
+void event_description_path(int eid, const char *filename, char *path, size_t size);
 
 #endif
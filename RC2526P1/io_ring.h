@@ -0,0 +1,51 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+/*
+ * Interface mínima para um io_uring, usando diretamente as chamadas ao sistema
+ * (io_uring_setup/io_uring_enter) e os anéis partilhados com o kernel.
+ */
+typedef struct IoRing {
+    int ring_fd;
+
+    // anel de submissão (SQ)
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned sqe_tail;      // cauda local, ainda não publicada ao kernel
+    unsigned to_submit;
+    struct io_uring_sqe *sqes;
+
+    // anel de conclusão (CQ)
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // zonas mapeadas
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+} IoRing;
+
+int io_ring_init(IoRing *ring, unsigned entries);
+void io_ring_destroy(IoRing *ring);
+
+// Obtém uma SQE livre (submetendo as pendentes se o anel estiver cheio)
+struct io_uring_sqe *io_ring_get_sqe(IoRing *ring);
+
+// Submete as SQEs pendentes e espera por pelo menos wait_nr conclusões, numa só chamada ao sistema
+int io_ring_submit_and_wait(IoRing *ring, unsigned wait_nr);
+
+// Devolve a próxima CQE disponível (ou NULL) e marca-a como consumida
+struct io_uring_cqe *io_ring_peek_cqe(IoRing *ring);
+void io_ring_cqe_seen(IoRing *ring);
+
+#endif
@@ -0,0 +1,131 @@
+#include "response.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Capacidade inicial de uma resposta dinâmica (suficiente para a maioria das listagens)
+#define RESPONSE_INITIAL_CAPACITY 1024
+
+/**
+ * Inicializa uma resposta escrita num buffer do chamador
+ */
+void response_init_fixed(ResponseBuilder *rb, char *buf, size_t size, size_t limit) {
+    rb->data = buf;
+    rb->len = 0;
+    rb->cap = size;
+    // o '\0' final tem de caber sempre no buffer
+    rb->limit = (limit == 0 || limit > size - 1) ? size - 1 : limit;
+    rb->fixed = true;
+    rb->failed = false;
+    rb->truncated = false;
+    rb->entries = 0;
+    buf[0] = '\0';
+}
+
+/**
+ * Inicializa uma resposta num buffer que cresce conforme necessário
+ */
+void response_init_dynamic(ResponseBuilder *rb, size_t limit) {
+    rb->data = NULL;
+    rb->len = 0;
+    rb->cap = 0;
+    rb->limit = limit;
+    rb->fixed = false;
+    rb->failed = false;
+    rb->truncated = false;
+    rb->entries = 0;
+}
+
+/**
+ * Garante espaço para mais size bytes (e o '\0'), duplicando a capacidade
+ */
+static bool response_reserve(ResponseBuilder *rb, size_t size) {
+    if (rb->len + size + 1 <= rb->cap) return true;
+    if (rb->fixed) return false;
+
+    size_t new_cap = rb->cap > 0 ? rb->cap : RESPONSE_INITIAL_CAPACITY;
+    while (new_cap < rb->len + size + 1) {
+        new_cap *= 2;
+    }
+    char *new_data = realloc(rb->data, new_cap);
+    if (new_data == NULL) {
+        rb->failed = true;
+        return false;
+    }
+    rb->data = new_data;
+    rb->cap = new_cap;
+    return true;
+}
+
+/**
+ * Formata texto no fim da resposta, desde que caiba no limite (deixando espaço para o '\n' final)
+ */
+static bool response_vappend(ResponseBuilder *rb, const char *fmt, va_list ap) {
+    if (rb->failed) return false;
+
+    va_list copy;
+    va_copy(copy, ap);
+    size_t room = rb->cap - rb->len;
+    int n = vsnprintf(room > 0 ? rb->data + rb->len : NULL, room, fmt, copy);
+    va_end(copy);
+    if (n < 0) return false;
+
+    if ((rb->limit > 0 && rb->len + n + 1 > rb->limit) || !response_reserve(rb, n + 1)) {
+        // o que o vsnprintf tenha escrito para lá do fim é descartado
+        if (rb->cap > rb->len) rb->data[rb->len] = '\0';
+        rb->truncated = !rb->failed;
+        return false;
+    }
+
+    // só é preciso formatar de novo se o buffer teve de crescer
+    if ((size_t)n >= room) {
+        vsnprintf(rb->data + rb->len, rb->cap - rb->len, fmt, ap);
+    }
+    rb->len += n;
+    return true;
+}
+
+/**
+ * Acrescenta texto à resposta
+ */
+bool response_append(ResponseBuilder *rb, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    bool ok = response_vappend(rb, fmt, ap);
+    va_end(ap);
+    return ok;
+}
+
+/**
+ * Acrescenta uma entrada da lista à resposta
+ */
+bool response_add_entry(ResponseBuilder *rb, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    bool ok = response_vappend(rb, fmt, ap);
+    va_end(ap);
+    if (ok) rb->entries++;
+    return ok;
+}
+
+/**
+ * Termina a resposta com '\n'. O espaço para este foi reservado por cada acrescento.
+ */
+size_t response_finish(ResponseBuilder *rb) {
+    if (rb->failed || !response_reserve(rb, 1)) return 0;
+    rb->data[rb->len++] = '\n';
+    rb->data[rb->len] = '\0';
+    return rb->len;
+}
+
+/**
+ * Liberta o buffer de uma resposta dinâmica
+ */
+void response_free(ResponseBuilder *rb) {
+    if (!rb->fixed) {
+        free(rb->data);
+    }
+    rb->data = NULL;
+    rb->len = 0;
+    rb->cap = 0;
+}
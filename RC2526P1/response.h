@@ -0,0 +1,43 @@
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Construção incremental de respostas com listas (LST, LME, LMR).
+ * Cada acrescento escreve a partir do fim da resposta (sem percorrer o que já foi escrito).
+ * A resposta pode ser escrita num buffer fixo (UDP) ou num buffer que cresce conforme necessário (TCP).
+ * Se uma entrada da lista fizer a resposta passar o limite, é descartada por inteiro e a resposta
+ * fica marcada como truncada: o limite corta sempre entre entradas, nunca a meio de uma.
+ */
+typedef struct ResponseBuilder {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t limit;       // tamanho máximo da resposta, incluindo o '\n' final (0 = sem limite)
+    bool fixed;         // buffer do chamador, que não pode crescer
+    bool failed;        // sem memória para crescer
+    bool truncated;     // houve entradas descartadas por causa do limite
+    int entries;
+} ResponseBuilder;
+
+// Escreve a resposta no buffer buf (de tamanho size), com no máximo limit bytes (0 = até ao tamanho do buffer)
+void response_init_fixed(ResponseBuilder *rb, char *buf, size_t size, size_t limit);
+
+// Escreve a resposta num buffer alocado dinamicamente, com no máximo limit bytes (0 = sem limite)
+void response_init_dynamic(ResponseBuilder *rb, size_t limit);
+
+// Acrescenta texto à resposta (por exemplo, o cabeçalho "RLS OK"); devolve false se não couber
+bool response_append(ResponseBuilder *rb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Acrescenta uma entrada da lista; devolve false (sem alterar a resposta) se esta passar o limite
+bool response_add_entry(ResponseBuilder *rb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Termina a resposta com '\n' e devolve o seu tamanho
+size_t response_finish(ResponseBuilder *rb);
+
+// Liberta o buffer de uma resposta dinâmica
+void response_free(ResponseBuilder *rb);
+
+#endif
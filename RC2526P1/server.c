@@ -1,89 +1,338 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include "server_logic.h"
 #include "data_manager.h"
 #include "structures.h"
+#include "connection.h"
+#ifdef HAVE_IO_URING
+#include "uring_backend.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
-#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <pthread.h>
 
-// Número máximo de clientes que o servidor pode gerir simultaneamente
-#define MAX_TCP_CLIENTS 10
+// Número máximo de eventos devolvidos por cada chamada a epoll_wait
+#define MAX_EPOLL_EVENTS 256
+
+// Tamanho por defeito da fila de conexões pendentes do socket de escuta
+#define DEFAULT_LISTEN_BACKLOG SOMAXCONN
+
+// Número máximo de workers (threads com loop de eventos próprio)
+#define MAX_WORKERS 256
+
+// Número máximo de datagramas lidos por cada recvmmsg no modo UDP em lote
+#define MAX_UDP_BATCH 1024
+
+// Tamanho máximo de um pedido UDP
+#define UDP_REQUEST_MAX 1024
+
+// Pedidos por conexão TCP persistente e segundos de inatividade até fechar uma conexão
+#define DEFAULT_KEEPALIVE_MAX_REQUESTS 100
+#define DEFAULT_IDLE_TIMEOUT 30
+
+// Tamanho máximo por defeito de uma resposta LST (as listagens maiores são cortadas entre eventos)
+#define DEFAULT_LIST_RESPONSE_MAX (1024 * 1024)
+
+// Tamanho mínimo aceite para os limites de resposta (cabeçalho e pelo menos uma entrada)
+#define MIN_RESPONSE_LIMIT 64
+
+// Intervalo (ms) entre verificações de conexões inativas
+#define IDLE_SWEEP_INTERVAL_MS 1000
 
 #define GROUP_NUMBER 66
 #define DEFAULT_PORT (58000 + GROUP_NUMBER)
 
+/*
+ * Buffers de um worker para a receção/envio de datagramas UDP em lote.
+ */
+typedef struct UdpBatch {
+    int size;
+    struct mmsghdr *requests;
+    struct mmsghdr *responses;
+    struct iovec *request_iovs;
+    struct iovec *response_iovs;
+    struct sockaddr_in *addrs;
+    char (*request_bufs)[UDP_REQUEST_MAX];
+    char (*response_bufs)[UDP_RESPONSE_MAX];
+} UdpBatch;
+
+/*
+ * Worker do servidor: uma thread com sockets UDP/TCP e loop de eventos próprios.
+ */
+typedef struct Worker {
+    int id;
+    int udp_fd;
+    int tcp_fd;
+    int epoll_fd;
+    ConnTable connections;
+    ServerState *server_data;
+    bool verbose;
+    bool use_uring;
+    UdpBatch *udp_batch;
+    pthread_t thread;
+} Worker;
+
+
+
+/**
+ * Eleva o limite de descritores abertos até ao máximo permitido,
+ * para que o servidor suporte dezenas de milhares de clientes TCP
+ */
+static void raise_fd_limit(bool verbose) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == 0 && verbose) {
+            printf("VERBOSE SERVER.C: File descriptor limit raised to %llu.\n", (unsigned long long)rl.rlim_cur);
+        }
+    }
+}
 
-int main(int argc, char *argv[]) {
-    int opt;
-    int port = DEFAULT_PORT;
-    bool verbose = false;
+/**
+ * Envia a resposta a um pedido UDP
+ */
+static void send_udp_response(int udp_fd, struct sockaddr_in *client_addr, const char *response_buffer, size_t response_len, bool verbose) {
+    ssize_t sent_bytes = sendto(udp_fd, response_buffer, response_len, 0,
+                                (struct sockaddr*)client_addr, sizeof(*client_addr));
+    if (sent_bytes == -1) {
+        perror("Erro ao enviar resposta UDP");
+    } else if (verbose) {
+        printf("VERBOSE: UDP response sent to %s:%d: %s", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), response_buffer);
+    }
+}
 
-    // parsing argumentos
-    while ((opt = getopt(argc, argv, "p:v")) != -1) {
-        switch (opt) {
-            case 'p':
-                port = atoi(optarg);
-                break;
-            case 'v':
-                verbose = true;
-                break;
-            default:
-                fprintf(stderr, "Uso: %s [-p ESport] [-v]\n", argv[0]);
-                exit(EXIT_FAILURE);
+/**
+ * Lê todos os datagramas pendentes no socket UDP (epoll em modo edge-triggered)
+ */
+static void handle_udp_readable(int udp_fd, ServerState *server_data, bool verbose) {
+    while (1) {
+        char buffer[1024];
+        char response_buffer[UDP_RESPONSE_MAX];
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        ssize_t n = recvfrom(udp_fd, buffer, sizeof(buffer) - 1, 0,
+                             (struct sockaddr*)&client_addr, &client_len);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Erro no recvfrom UDP");
+            }
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (n > 0) {
+            buffer[n] = '\0';
+            size_t response_len = process_udp_request(&client_addr, buffer, response_buffer, sizeof(response_buffer), server_data, verbose);
+            send_udp_response(udp_fd, &client_addr, response_buffer, response_len, verbose);
         }
     }
+}
 
-    printf("Servidor de Eventos (ES) a iniciar...\n");
-    if (verbose) {
-        printf("VERBOSE SERVER.C: Verbose mode enabled.\n");
+/**
+ * Aloca os buffers para receber e responder a até batch_size datagramas de uma só vez
+ */
+static UdpBatch *udp_batch_create(int batch_size) {
+    UdpBatch *batch = calloc(1, sizeof(UdpBatch));
+    if (batch == NULL) return NULL;
+
+    batch->size = batch_size;
+    batch->requests = calloc(batch_size, sizeof(struct mmsghdr));
+    batch->responses = calloc(batch_size, sizeof(struct mmsghdr));
+    batch->request_iovs = calloc(batch_size, sizeof(struct iovec));
+    batch->response_iovs = calloc(batch_size, sizeof(struct iovec));
+    batch->addrs = calloc(batch_size, sizeof(struct sockaddr_in));
+    batch->request_bufs = calloc(batch_size, UDP_REQUEST_MAX);
+    batch->response_bufs = calloc(batch_size, UDP_RESPONSE_MAX);
+    if (!batch->requests || !batch->responses || !batch->request_iovs || !batch->response_iovs ||
+        !batch->addrs || !batch->request_bufs || !batch->response_bufs) {
+        handle_error("Erro ao alocar buffers UDP em lote");
     }
 
-    // estado global do servidor
-    ServerState server_data;
-    server_data.next_eid = 1;
+    for (int i = 0; i < batch_size; i++) {
+        batch->request_iovs[i].iov_base = batch->request_bufs[i];
+        batch->request_iovs[i].iov_len = UDP_REQUEST_MAX - 1;
+        batch->requests[i].msg_hdr.msg_iov = &batch->request_iovs[i];
+        batch->requests[i].msg_hdr.msg_iovlen = 1;
+        batch->requests[i].msg_hdr.msg_name = &batch->addrs[i];
+
+        batch->response_iovs[i].iov_base = batch->response_bufs[i];
+        batch->responses[i].msg_hdr.msg_iov = &batch->response_iovs[i];
+        batch->responses[i].msg_hdr.msg_iovlen = 1;
+        batch->responses[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->responses[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    return batch;
+}
+
+/**
+ * Lê os datagramas pendentes em lotes com recvmmsg, processa-os e envia todas as
+ * respostas de cada lote com um só sendmmsg
+ */
+static void handle_udp_readable_batched(int udp_fd, UdpBatch *batch, ServerState *server_data, bool verbose) {
+    while (1) {
+        for (int i = 0; i < batch->size; i++) {
+            batch->requests[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+
+        int received = recvmmsg(udp_fd, batch->requests, batch->size, MSG_DONTWAIT, NULL);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Erro no recvmmsg UDP");
+            }
+            return;
+        }
+        if (received == 0) return;
+
+        STATS_ADD(&server_data->stats, udp_batches, 1);
+        STATS_ADD(&server_data->stats, udp_batch_datagrams, received);
+        if (received == batch->size) STATS_ADD(&server_data->stats, udp_batch_full, 1);
+        stats_update_max(&server_data->stats.udp_batch_max, received);
+
+        int to_send = 0;
+        for (int i = 0; i < received; i++) {
+            unsigned int n = batch->requests[i].msg_len;
+            if (n == 0) continue;
+            batch->request_bufs[i][n] = '\0';
+
+            size_t response_len = process_udp_request(&batch->addrs[i], batch->request_bufs[i], batch->response_bufs[i],
+                                                      UDP_RESPONSE_MAX, server_data, verbose);
+            // as respostas são compactadas no início do array, mantendo a ordem dos pedidos
+            batch->response_iovs[to_send].iov_base = batch->response_bufs[i];
+            batch->response_iovs[to_send].iov_len = response_len;
+            batch->responses[to_send].msg_hdr.msg_name = &batch->addrs[i];
+            to_send++;
+        }
+
+        int sent = 0;
+        while (sent < to_send) {
+            int n = sendmmsg(udp_fd, batch->responses + sent, to_send - sent, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // descartar a resposta que falhou e continuar com as restantes
+                perror("Erro ao enviar resposta UDP");
+                sent++;
+                continue;
+            }
+            if (verbose) {
+                for (int i = sent; i < sent + n; i++) {
+                    struct sockaddr_in *addr = batch->responses[i].msg_hdr.msg_name;
+                    printf("VERBOSE: UDP response sent to %s:%d: %.*s", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port),
+                           (int)batch->response_iovs[i].iov_len, (char *)batch->response_iovs[i].iov_base);
+                }
+            }
+            sent += n;
+        }
 
-    // diretorias de persistência
-    mkdir("USERS", 0700);
-    mkdir("EVENTS", 0700);
+        // um lote incompleto significa que a fila do socket ficou vazia
+        if (received < batch->size) return;
+    }
+}
 
-    // carregar next_eid de ficheiro (se existir)
-    char eid_file_path[64];
-    snprintf(eid_file_path, sizeof(eid_file_path), "EVENTS/eid.dat");
-    FILE *eid_file = fopen(eid_file_path, "r");
-    if (eid_file != NULL) {
-        if (fscanf(eid_file, "%d", &server_data.next_eid) != 1) {
-            fprintf(stderr, "Erro ao ler next_eid de %s. A usar 1.\n", eid_file_path);
-            server_data.next_eid = 1;
+/**
+ * Aceita todas as conexões TCP pendentes e regista-as no epoll e na tabela de conexões
+ */
+static void accept_tcp_clients(int tcp_fd, int epoll_fd, ConnTable *connections, bool verbose) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int new_tcp_fd = accept4(tcp_fd, (struct sockaddr*)&client_addr, &client_len, SOCK_NONBLOCK);
+        if (new_tcp_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Erro no accept");
+            }
+            return;
         }
-        fclose(eid_file);
+
+        if (conn_table_add(connections, new_tcp_fd, &client_addr) == NULL) {
+            fprintf(stderr, "Out of memory for TCP connection table. Connection rejected (fd: %d).\n", new_tcp_fd);
+            close(new_tcp_fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = new_tcp_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_tcp_fd, &ev) == -1) {
+            perror("Erro ao registar cliente TCP no epoll");
+            conn_table_remove(connections, new_tcp_fd);
+            close(new_tcp_fd);
+            continue;
+        }
+
         if (verbose) {
-            printf("VERBOSE SERVER.C: Loaded next_eid from %s: %d\n", eid_file_path, server_data.next_eid);
+            printf("VERBOSE SERVER.C: New TCP connection accepted from %s:%d (fd: %d, active: %d).\n",
+                   inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), new_tcp_fd, connections->count);
         }
-    } else {
+    }
+}
+
+/**
+ * Fecha uma conexão TCP e remove-a da tabela (o fecho remove-a também do epoll)
+ */
+static void close_tcp_client(int fd, ConnTable *connections) {
+    // shutdown para garantir que todos os dados são enviados antes de fechar
+    shutdown(fd, SHUT_WR);
+    close(fd);
+    conn_table_remove(connections, fd);
+}
+
+/**
+ * Avança o processamento de um cliente TCP quando o seu socket fica pronto.
+ * Nenhuma operação bloqueia: um cliente lento não atrasa os restantes.
+ */
+static void handle_tcp_client(int fd, ConnTable *connections, ServerState *server_data, bool verbose) {
+    Connection *conn = conn_table_get(connections, fd);
+    if (conn == NULL) return;
+
+    conn_table_touch(connections, conn);
+    if (!conn_handle_io(conn, server_data, verbose)) {
+        close_tcp_client(fd, connections);
+    }
+}
+
+/**
+ * Fecha as conexões TCP sem atividade há mais de idle_timeout segundos
+ */
+static void close_idle_tcp_clients(ConnTable *connections, int idle_timeout, bool verbose) {
+    Connection *conn;
+    while ((conn = conn_table_next_expired(connections, idle_timeout)) != NULL) {
         if (verbose) {
-            printf("VERBOSE SERVER.C: File %s not found. Initializing next_eid to 1.\n", eid_file_path);
+            printf("VERBOSE SERVER.C: TCP client (fd: %d) idle for %ds, closing connection.\n", conn->fd, idle_timeout);
         }
+        close_tcp_client(conn->fd, connections);
     }
+}
 
-    // criação socket UDP
-    int udp_fd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len;
 
-    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+/**
+ * Cria o socket UDP do servidor. Com vários workers, cada um tem o seu socket
+ * associado à mesma porta através de SO_REUSEPORT e o kernel distribui os datagramas.
+ */
+static int create_udp_socket(int port, bool reuse_port) {
+    int udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
     if (udp_fd == -1) {
         handle_error("Erro ao criar socket UDP");
     }
 
+    int reuse = 1;
+    if (reuse_port && setsockopt(udp_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1) {
+        handle_error("Erro no setsockopt SO_REUSEPORT (UDP)");
+    }
+
     // binding
+    struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -92,142 +341,338 @@ int main(int argc, char *argv[]) {
     if (bind(udp_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
         handle_error("Erro no bind do socket UDP");
     }
+    return udp_fd;
+}
 
-    printf("Servidor UDP a escutar na porta %d\n", port);
-
-    // criar Socket TCP de escuta
-    int tcp_fd;
-    tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+/**
+ * Cria o socket TCP de escuta do servidor (partilhando a porta com SO_REUSEPORT se necessário)
+ */
+static int create_tcp_socket(int port, int listen_backlog, bool reuse_port) {
+    int tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (tcp_fd == -1) {
         handle_error("Erro ao criar socket TCP");
     }
 
+    // permitir reiniciar o servidor sem esperar que as conexões antigas saiam de TIME_WAIT
+    int reuse = 1;
+    if (setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1) {
+        handle_error("Erro no setsockopt SO_REUSEADDR");
+    }
+    if (reuse_port && setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1) {
+        handle_error("Erro no setsockopt SO_REUSEPORT (TCP)");
+    }
+
     // associar o socket TCP à mesma porta
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_port = htons(port);
+
     if (bind(tcp_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
         handle_error("Erro no bind do socket TCP");
     }
 
     // colocar o socket em modo de escuta
-    if (listen(tcp_fd, 5) == -1) {
+    if (listen(tcp_fd, listen_backlog) == -1) {
         handle_error("Erro no listen do socket TCP");
     }
+    return tcp_fd;
+}
 
-    printf("Servidor TCP a escutar na porta %d\n", port);
+/**
+ * Cria os sockets e a instância epoll de um worker
+ */
+static void worker_init(Worker *worker, int id, int port, int listen_backlog, bool reuse_port, bool use_uring, int udp_batch_size, ServerState *server_data, bool verbose) {
+    worker->id = id;
+    worker->server_data = server_data;
+    worker->verbose = verbose;
+    worker->use_uring = use_uring;
+    worker->udp_fd = create_udp_socket(port, reuse_port);
+    worker->tcp_fd = create_tcp_socket(port, listen_backlog, reuse_port);
+
+    // com o backend io_uring, o loop de eventos é criado pela própria thread do worker
+    if (use_uring) return;
+
+    if (udp_batch_size > 1) {
+        worker->udp_batch = udp_batch_create(udp_batch_size);
+    }
 
-    // integrar select() e gerir conexões TCP ativas
-    fd_set read_fds;
-    int max_fd_current;
+    // instância epoll que monitoriza o socket UDP, o de escuta TCP e todos os clientes TCP do worker
+    worker->epoll_fd = epoll_create1(0);
+    if (worker->epoll_fd == -1) {
+        handle_error("Erro ao criar instância epoll");
+    }
 
-    // array para guardar os descritores de ficheiro dos sockets TCP dos clientes ativos
-    int client_tcp_fds[MAX_TCP_CLIENTS];
-    for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
-        client_tcp_fds[i] = 0;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = worker->udp_fd;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->udp_fd, &ev) == -1) {
+        handle_error("Erro ao registar socket UDP no epoll");
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = worker->tcp_fd;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->tcp_fd, &ev) == -1) {
+        handle_error("Erro ao registar socket TCP no epoll");
     }
 
-    while (1) {
-        FD_ZERO(&read_fds);
-        FD_SET(udp_fd, &read_fds);
-        FD_SET(tcp_fd, &read_fds);
-        
-        max_fd_current = (udp_fd > tcp_fd) ? udp_fd : tcp_fd;
-
-        // adicionar todos os sockets TCP de clientes ativos ao conjunto
-        for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
-            if (client_tcp_fds[i] > 0) {
-                FD_SET(client_tcp_fds[i], &read_fds);
-                if (client_tcp_fds[i] > max_fd_current) {
-                    max_fd_current = client_tcp_fds[i];
-                }
-            }
-        }
+    // tabela de conexões TCP ativas, sem limite fixo de clientes
+    conn_table_init(&worker->connections);
+}
+
+/**
+ * Loop de eventos de um worker
+ */
+static void *worker_run(void *arg) {
+    Worker *worker = arg;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+#ifdef HAVE_IO_URING
+    if (worker->use_uring) {
+        uring_worker_run(worker->id, worker->udp_fd, worker->tcp_fd, worker->server_data, worker->verbose);
+        return NULL;
+    }
+#endif
+
+    if (worker->verbose) {
+        printf("VERBOSE SERVER.C: Worker %d started (udp fd: %d, tcp fd: %d).\n", worker->id, worker->udp_fd, worker->tcp_fd);
+    }
 
+    int idle_timeout = worker->server_data->idle_timeout;
+    while (1) {
         // bloquear até que haja atividade num dos sockets monitorizados
-        if (select(max_fd_current + 1, &read_fds, NULL, NULL, NULL) < 0) {
-            handle_error("Erro no select");
+        // (com clientes ligados, acordar periodicamente para fechar os inativos)
+        int wait_ms = (idle_timeout > 0 && worker->connections.count > 0) ? IDLE_SWEEP_INTERVAL_MS : -1;
+        int n_events = epoll_wait(worker->epoll_fd, events, MAX_EPOLL_EVENTS, wait_ms);
+        stats_print_if_requested(&worker->server_data->stats);
+        if (n_events < 0) {
+            if (errno == EINTR) continue;
+            handle_error("Erro no epoll_wait");
         }
 
-        // verificar se há atividade no socket UDP
-        if (FD_ISSET(udp_fd, &read_fds)) {
-            char buffer[1024];
-            client_len = sizeof(client_addr);
+        for (int e = 0; e < n_events; e++) {
+            int fd = events[e].data.fd;
 
-            ssize_t n = recvfrom(udp_fd, buffer, sizeof(buffer) - 1, 0,
-                                 (struct sockaddr*)&client_addr, &client_len);
-            if (n > 0) {
-                buffer[n] = '\0';
-                process_udp_request(udp_fd, &client_addr, buffer, &server_data, verbose);
+            if (fd == worker->udp_fd) {
+                if (worker->udp_batch != NULL) {
+                    handle_udp_readable_batched(worker->udp_fd, worker->udp_batch, worker->server_data, worker->verbose);
+                } else {
+                    handle_udp_readable(worker->udp_fd, worker->server_data, worker->verbose);
+                }
+            } else if (fd == worker->tcp_fd) {
+                accept_tcp_clients(worker->tcp_fd, worker->epoll_fd, &worker->connections, worker->verbose);
+            } else {
+                handle_tcp_client(fd, &worker->connections, worker->server_data, worker->verbose);
             }
         }
 
-        // verificar se há atividade no socket TCP de escuta
-        if (FD_ISSET(tcp_fd, &read_fds)) {
-            int new_tcp_fd;
-            client_len = sizeof(client_addr);
-            new_tcp_fd = accept(tcp_fd, (struct sockaddr*)&client_addr, &client_len);
-            if (new_tcp_fd < 0) {
-                perror("Erro no accept");
-            }
+        close_idle_tcp_clients(&worker->connections, idle_timeout, worker->verbose);
+    }
+
+    conn_table_destroy(&worker->connections);
+    close(worker->epoll_fd);
+    close(worker->udp_fd);
+    close(worker->tcp_fd);
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int port = DEFAULT_PORT;
+    int listen_backlog = DEFAULT_LISTEN_BACKLOG;
+    int num_workers = 1;
+    bool use_uring = false;
+    int udp_batch_size = 1;
+    int keepalive_max_requests = DEFAULT_KEEPALIVE_MAX_REQUESTS;
+    int idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    long list_response_max = DEFAULT_LIST_RESPONSE_MAX;
+    long udp_response_max = UDP_RESPONSE_MAX;
+    const char *storage_engine = "files";
+    bool verbose = false;
 
-            else {
-                // encontrar um slot vazio no array client_tcp_fds
-                int i;
-                for (i = 0; i < MAX_TCP_CLIENTS; i++) {
-                    if (client_tcp_fds[i] == 0) {
-                        client_tcp_fds[i] = new_tcp_fd;
-                        if (verbose) {
-                            printf("VERBOSE SERVER.C: New TCP connection accepted from %s:%d (fd: %d).\n",
-                                   inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), new_tcp_fd);
-                        }
-                        break;
-                    }
+    // parsing argumentos
+    while ((opt = getopt(argc, argv, "p:b:t:uB:k:i:L:U:S:v")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'b':
+                listen_backlog = atoi(optarg);
+                if (listen_backlog <= 0) {
+                    fprintf(stderr, "Backlog inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
                 }
-                if (i == MAX_TCP_CLIENTS) {
-                    fprintf(stderr, "Maximum number of TCP clients reached. Connection rejected (fd: %d).\n", new_tcp_fd);
-                    close(new_tcp_fd);
+                break;
+            case 't':
+                num_workers = atoi(optarg);
+                // -t 0: um worker por cada core disponível
+                if (num_workers == 0) {
+                    num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
                 }
-            }
+                if (num_workers <= 0 || num_workers > MAX_WORKERS) {
+                    fprintf(stderr, "Número de workers inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'B':
+                udp_batch_size = atoi(optarg);
+                if (udp_batch_size <= 0 || udp_batch_size > MAX_UDP_BATCH) {
+                    fprintf(stderr, "Tamanho de lote UDP inválido: %s (1 a %d)\n", optarg, MAX_UDP_BATCH);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                keepalive_max_requests = atoi(optarg);
+                if (keepalive_max_requests < 0) {
+                    fprintf(stderr, "Número de pedidos por conexão inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'i':
+                idle_timeout = atoi(optarg);
+                if (idle_timeout < 0) {
+                    fprintf(stderr, "Tempo de inatividade inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'L':
+                list_response_max = atol(optarg);
+                if (list_response_max != 0 && list_response_max < MIN_RESPONSE_LIMIT) {
+                    fprintf(stderr, "Tamanho máximo de listagem inválido: %s (0 ou pelo menos %d bytes)\n", optarg, MIN_RESPONSE_LIMIT);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'U':
+                udp_response_max = atol(optarg);
+                if (udp_response_max < MIN_RESPONSE_LIMIT || udp_response_max > UDP_RESPONSE_MAX) {
+                    fprintf(stderr, "Tamanho máximo de resposta UDP inválido: %s (%d a %d bytes)\n", optarg, MIN_RESPONSE_LIMIT, UDP_RESPONSE_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                storage_engine = optarg;
+                if (strcmp(storage_engine, "files") != 0 && strcmp(storage_engine, "log") != 0) {
+                    fprintf(stderr, "Motor de armazenamento inválido: %s (files ou log)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'u':
+#ifdef HAVE_IO_URING
+                use_uring = true;
+                break;
+#else
+                fprintf(stderr, "Este ES foi compilado sem suporte para io_uring (make IO_URING=1).\n");
+                exit(EXIT_FAILURE);
+#endif
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fprintf(stderr, "Uso: %s [-p ESport] [-b backlog] [-t workers] [-u] [-B udp_batch] [-k max_requests] [-i idle_timeout] [-L list_max] [-U udp_max] [-S files|log] [-v]\n", argv[0]);
+                exit(EXIT_FAILURE);
         }
+    }
 
-        // verificar se há atividade nos sockets TCP dos clientes ativos
-        for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
-            if (client_tcp_fds[i] > 0 && FD_ISSET(client_tcp_fds[i], &read_fds)) {
-                char tcp_buffer[1024];
-                memset(tcp_buffer, 0, sizeof(tcp_buffer));
-                ssize_t bytes_read = read(client_tcp_fds[i], tcp_buffer, sizeof(tcp_buffer) - 1);
-
-                // conexão fechada pelo cliente ou erro
-                if (bytes_read <= 0) {
-                    if (bytes_read == 0) {
-                        if (verbose) {
-                            printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected.\n", client_tcp_fds[i]);
-                        }
-                    } else {
-                        perror("Erro ao ler do socket TCP do cliente");
-                    }
-                    close(client_tcp_fds[i]);
-                    client_tcp_fds[i] = 0;
-                } else {
-                    if (verbose) {
-                        printf("VERBOSE SERVER.C: Received data from TCP client (fd: %d), processing...\n", client_tcp_fds[i]);
-                    }
-
-                    char response_buffer[8192];
-                    memset(response_buffer, 0, sizeof(response_buffer));
-                    process_tcp_request(client_tcp_fds[i], tcp_buffer, bytes_read, &server_data, verbose, response_buffer, sizeof(response_buffer));
-
-                    if (strlen(response_buffer) > 0) {
-                        write(client_tcp_fds[i], response_buffer, strlen(response_buffer));
-                    }
-
-                    // shutdown para garantir que todos os dados são enviados antes de fechar
-                    shutdown(client_tcp_fds[i], SHUT_WR);
-                    close(client_tcp_fds[i]);
-                    client_tcp_fds[i] = 0;
-                }
-            }
+    printf("Servidor de Eventos (ES) a iniciar...\n");
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Verbose mode enabled.\n");
+    }
+    raise_fd_limit(verbose);
+
+#ifdef HAVE_IO_URING
+    if (use_uring && !uring_backend_available()) {
+        fprintf(stderr, "io_uring não está disponível neste kernel. A usar epoll.\n");
+        use_uring = false;
+    }
+#endif
+
+    // escritas em sockets fechados pelo cliente devolvem EPIPE em vez de terminar o servidor
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGUSR1 imprime as estatísticas do servidor (sem SA_RESTART, para interromper o epoll_wait)
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stats_request_print;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    // estado global do servidor, partilhado por todos os workers
+    ServerState server_data;
+    memset(&server_data, 0, sizeof(server_data));
+    server_data.next_eid = 1;
+    server_data.keepalive_max_requests = keepalive_max_requests;
+    server_data.idle_timeout = idle_timeout;
+    server_data.list_response_max = list_response_max;
+    server_data.udp_response_max = udp_response_max;
+    pthread_mutex_init(&server_data.eid_lock, NULL);
+    pthread_mutex_init(&server_data.reservation_lock, NULL);
+    pthread_mutex_init(&server_data.users_lock, NULL);
+
+    // diretorias de persistência (USERS/ e EVENTS/, ou STORE/ com o log) e recuperação do log
+    if (!storage_open(storage_engine, &server_data.stats, verbose)) {
+        handle_error("Erro ao abrir o armazenamento");
+    }
+
+    // os utilizadores ficam em memória: a autenticação não acede ao disco
+    int users_loaded = load_users();
+    if (users_loaded < 0) {
+        handle_error("Erro ao ler os utilizadores guardados");
+    }
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Loaded %d users (%s storage).\n", users_loaded, storage_engine);
+    }
+
+    // o estado dos eventos também: as consultas deixam de reler START_/RES_/END_
+    int events_loaded = load_events();
+    if (events_loaded < 0) {
+        handle_error("Erro ao ler os eventos guardados");
+    }
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Loaded %d events (%s storage).\n", events_loaded, storage_engine);
+    }
+
+    server_data.next_eid = load_next_eid();
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Loaded next_eid: %d\n", server_data.next_eid);
+    }
+
+    // cada worker tem os seus próprios sockets UDP e TCP e o seu loop de eventos
+    bool reuse_port = num_workers > 1;
+    Worker *workers = calloc(num_workers, sizeof(Worker));
+    if (workers == NULL) {
+        handle_error("Erro ao alocar workers");
+    }
+    for (int i = 0; i < num_workers; i++) {
+        worker_init(&workers[i], i, port, listen_backlog, reuse_port, use_uring, udp_batch_size, &server_data, verbose);
+    }
+
+    printf("Servidor UDP a escutar na porta %d\n", port);
+    printf("Servidor TCP a escutar na porta %d (backlog %d)\n", port, listen_backlog);
+    if (num_workers > 1) {
+        printf("A usar %d workers\n", num_workers);
+    }
+    if (strcmp(storage_engine, "log") == 0) {
+        printf("A usar o armazenamento em log (STORE/)\n");
+    }
+    if (use_uring) {
+        printf("A usar o backend io_uring\n");
+    } else if (udp_batch_size > 1) {
+        printf("A usar receção UDP em lotes de até %d datagramas\n", udp_batch_size);
+    }
+
+    // o worker 0 corre na thread principal
+    for (int i = 1; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+            handle_error("Erro ao criar thread do worker");
         }
     }
-    close(udp_fd);
-    close(tcp_fd);
+    worker_run(&workers[0]);
+
+    for (int i = 1; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    free(workers);
+    storage_close();
     return 0;
 }
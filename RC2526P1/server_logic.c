@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include "server_logic.h"
 #include "data_manager.h"
 #include <stdio.h>
@@ -6,16 +8,53 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
-#include <dirent.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include "utils.h"
+#include "response.h"
+
+// Número de campos do cabeçalho de um CRE (incluindo o comando), cada um seguido de um espaço
+#define CRE_HEADER_FIELDS 9
+
+// Tamanho máximo do ficheiro de descrição de um evento (10 MB)
+#define MAX_FILE_SIZE 10000000L
+
+/*
+ * Contexto das listagens LME e LMR, construídas com os visitantes do data_manager.
+ */
+typedef struct UserListing {
+    ResponseBuilder *rb;
+    const char *uid;
+    int count;
+} UserListing;
+
+/**
+ * Acrescenta à resposta do LME um evento criado pelo utilizador
+ */
+static bool list_owner_event_entry(const Event *event, void *ctx) {
+    UserListing *listing = ctx;
+    if (strcmp(event->owner_uid, listing->uid) != 0) return true;
+    listing->count++;
+    // depois de atingido o limite da resposta, os restantes eventos já não são acrescentados
+    return response_add_entry(listing->rb, " %03d %d", event->eid, event->state);
+}
+
+/**
+ * Acrescenta à resposta do LMR uma reserva do utilizador, até ao limite de 50
+ */
+static bool list_reservation_entry(const Reservation *reservation, void *ctx) {
+    UserListing *listing = ctx;
+    if (!response_add_entry(listing->rb, " %03d %s %d", reservation->eid, reservation->datetime, reservation->seats)) {
+        return false;
+    }
+    return ++listing->count < 50;
+}
 
-void process_udp_request(int udp_fd, struct sockaddr_in *client_addr, char *buffer, ServerState *server_data, bool verbose) {
-    char response_buffer[1024];
+size_t process_udp_request(struct sockaddr_in *client_addr, char *buffer, char *response_buffer, size_t response_size, ServerState *server_data, bool verbose) {
     char command[4];
     char uid_str[7];
     char password_str[9];
-    socklen_t client_len = sizeof(*client_addr);
 
     if (verbose) {
         buffer[strcspn(buffer, "\n")] = 0;
@@ -28,151 +67,136 @@ void process_udp_request(int udp_fd, struct sockaddr_in *client_addr, char *buff
         // login (LIN/RLI)
         if (strcmp(command, "LIN") == 0) {
             if (sscanf(buffer, "%*s %6s %8s", uid_str, password_str) != 2) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLI ERR\n");
+                snprintf(response_buffer, response_size, "RLI ERR\n");
                 if (verbose) printf("Verbose: LIN failed. Reason: Invalid syntax (missing arguments).\n");
             
             } else if (!is_valid_uid(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLI ERR\n");
+                snprintf(response_buffer, response_size, "RLI ERR\n");
                 if (verbose) printf("Verbose: LIN failed. Reason: Invalid UID format for '%s'.\n", uid_str);
             }
             
             else if (!is_valid_password(password_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLI ERR\n");
+                snprintf(response_buffer, response_size, "RLI ERR\n");
                 if (verbose) printf("Verbose: LIN failed for %s. Reason: Invalid password format.\n", uid_str);
             }
             
-            else if (!user_exists(uid_str) || !user_password_file_exists(uid_str)) {
-                create_user_files(uid_str, password_str);
-                create_login_file(uid_str);
-                snprintf(response_buffer, sizeof(response_buffer), "RLI REG\n");
-                if (verbose) printf("Verbose: New user %s registered and logged in. Files created.\n", uid_str);
-            
-            } else {
-                if (check_user_password(uid_str, password_str)) {
+            else {
+                // o registo de um utilizador novo não pode ser feito em simultâneo por dois workers
+                pthread_mutex_lock(&server_data->users_lock);
+                if (!user_exists(uid_str) || !user_password_file_exists(uid_str)) {
+                    create_user_files(uid_str, password_str);
+                    create_login_file(uid_str);
+                    snprintf(response_buffer, response_size, "RLI REG\n");
+                    if (verbose) printf("Verbose: New user %s registered and logged in. Files created.\n", uid_str);
+                
+                } else if (check_user_password(uid_str, password_str)) {
                     create_login_file(uid_str);
-                    snprintf(response_buffer, sizeof(response_buffer), "RLI OK\n");
+                    snprintf(response_buffer, response_size, "RLI OK\n");
                     if (verbose) printf("Verbose: User %s logged in successfully.\n", uid_str);
+                
                 } else {
-                    snprintf(response_buffer, sizeof(response_buffer), "RLI NOK\n");
+                    snprintf(response_buffer, response_size, "RLI NOK\n");
                     if (verbose) printf("Verbose: LIN failed for %s. Reason: Incorrect password.\n", uid_str);
                 }
+                pthread_mutex_unlock(&server_data->users_lock);
             }
 
         // logout (LOU/RLO)
         } else if (strcmp(command, "LOU") == 0) {
             if (sscanf(buffer, "%*s %6s %8s", uid_str, password_str) != 2) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLO NOK\n");
+                snprintf(response_buffer, response_size, "RLO NOK\n");
                 if (verbose) printf("Verbose: LOU failed. Reason: Request from a non-logged-in client.\n");
             
             } else if (!is_valid_uid(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLO ERR\n");
+                snprintf(response_buffer, response_size, "RLO ERR\n");
                 if (verbose) printf("Verbose: LOU failed. Reason: Invalid UID format for '%s'.\n", uid_str);
             
             } else if (!user_exists(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLO UNR\n");
+                snprintf(response_buffer, response_size, "RLO UNR\n");
                 if (verbose) printf("Verbose: LOU failed for %s. Reason: User not registered.\n", uid_str);
             
             } else if (!check_user_password(uid_str, password_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLO WRP\n");
+                snprintf(response_buffer, response_size, "RLO WRP\n");
                 if (verbose) printf("Verbose: LOU failed for %s. Reason: Incorrect password.\n", uid_str);
             
             } else if (!is_user_logged_in(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RLO NOK\n");
+                snprintf(response_buffer, response_size, "RLO NOK\n");
                 if (verbose) printf("Verbose: LOU failed for %s. Reason: User not logged in.\n", uid_str);
             
             } else {
                 remove_login_file(uid_str);
-                snprintf(response_buffer, sizeof(response_buffer), "RLO OK\n");
+                snprintf(response_buffer, response_size, "RLO OK\n");
                 if (verbose) printf("Verbose: User %s logged out successfully. Login file removed.\n", uid_str);
             }
         
         // unregister (UNR/RUR)
         } else if (strcmp(command, "UNR") == 0) {
             if (sscanf(buffer, "%*s %6s %8s", uid_str, password_str) != 2) {
-                snprintf(response_buffer, sizeof(response_buffer), "RUR NOK\n");
+                snprintf(response_buffer, response_size, "RUR NOK\n");
                 if (verbose) printf("Verbose: UNR failed. Reason: Request from a non-logged-in client.\n");
             
             } else if (!is_valid_uid(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RUR ERR\n");
+                snprintf(response_buffer, response_size, "RUR ERR\n");
                 if (verbose) printf("Verbose: UNR failed. Reason: Invalid UID format for '%s'.\n", uid_str);
             
             } else if (!user_exists(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RUR UNR\n");
+                snprintf(response_buffer, response_size, "RUR UNR\n");
                 if (verbose) printf("Verbose: UNR failed for %s. Reason: User not registered.\n", uid_str);
             
             } else if (!check_user_password(uid_str, password_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RUR WRP\n");
+                snprintf(response_buffer, response_size, "RUR WRP\n");
                 if (verbose) printf("Verbose: UNR failed for %s. Reason: Incorrect password.\n", uid_str);
             
             } else if (!is_user_logged_in(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RUR NOK\n");
+                snprintf(response_buffer, response_size, "RUR NOK\n");
                 if (verbose) printf("Verbose: UNR failed for %s. Reason: User not logged in.\n", uid_str);
             
             } else {
+                pthread_mutex_lock(&server_data->users_lock);
                 remove_user_files(uid_str);
-                snprintf(response_buffer, sizeof(response_buffer), "RUR OK\n");
+                pthread_mutex_unlock(&server_data->users_lock);
+                snprintf(response_buffer, response_size, "RUR OK\n");
                 if (verbose) printf("Verbose: User %s unregistered successfully. User files removed.\n", uid_str);
             }
         
         // myevents (LME/RME)
         } else if (strcmp(command, "LME") == 0) {
             if (sscanf(buffer, "%*s %6s %8s", uid_str, password_str) != 2) {
-                snprintf(response_buffer, sizeof(response_buffer), "RME NLG\n");
+                snprintf(response_buffer, response_size, "RME NLG\n");
                 if (verbose) printf("Verbose: LME failed. Reason: Request from a non-logged-in client.\n");
             
             } else if (!is_valid_uid(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RME ERR\n");
+                snprintf(response_buffer, response_size, "RME ERR\n");
                 if (verbose) printf("Verbose: LME failed. Reason: Invalid UID format for '%s'.\n", uid_str);
             
             } else if (!user_exists(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RME UNR\n");
+                snprintf(response_buffer, response_size, "RME UNR\n");
                 if (verbose) printf("Verbose: LME failed for %s. Reason: User not registered.\n", uid_str);
             
             } else if (!check_user_password(uid_str, password_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RME WRP\n");
+                snprintf(response_buffer, response_size, "RME WRP\n");
                 if (verbose) printf("Verbose: LME failed for %s. Reason: Incorrect password.\n", uid_str);
             
             } else if (!is_user_logged_in(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RME NLG\n");
+                snprintf(response_buffer, response_size, "RME NLG\n");
                 if (verbose) printf("Verbose: LME failed for %s. Reason: User not logged in.\n", uid_str);
             
             } else {
-                char created_dir_path[64];
-                snprintf(created_dir_path, sizeof(created_dir_path), "USERS/%s/CREATED", uid_str);
-
-                struct dirent **namelist;
-                int n = scandir(created_dir_path, &namelist, NULL, alphasort);
-
-                if (n <= 2) {
-                    snprintf(response_buffer, sizeof(response_buffer), "RME NOK\n");
+                ResponseBuilder rb;
+                response_init_fixed(&rb, response_buffer, response_size, server_data->udp_response_max);
+                response_append(&rb, "RME OK");
+                UserListing listing = { &rb, uid_str, 0 };
+                for_each_event(list_owner_event_entry, &listing);
+
+                if (listing.count == 0) {
+                    snprintf(response_buffer, response_size, "RME NOK\n");
                     if (verbose) printf("Verbose: User %s has not created any events.\n", uid_str);
-                    if (n > 0) {
-                        for(int i=0; i<n; i++) free(namelist[i]);
-                        free(namelist);
-                    }
                 } else {
-                    char temp_response[4096] = "RME OK";
-                    for (int i = 0; i < n; i++) {
-                        if (namelist[i]->d_name[0] == '.') {
-                            free(namelist[i]);
-                            continue;
-                        }
-                        
-                        char eid_str[4];
-                        strncpy(eid_str, namelist[i]->d_name, 3);
-                        eid_str[3] = '\0';
-
-                        int state = get_event_state(eid_str);
-
-                        char event_info[10];
-                        snprintf(event_info, sizeof(event_info), " %s %d", eid_str, state);
-                        strcat(temp_response, event_info);
-
-                        free(namelist[i]);
+                    response_finish(&rb);
+                    if (rb.truncated) {
+                        STATS_ADD(&server_data->stats, list_truncated, 1);
+                        if (verbose) printf("Verbose: LME reply for user %s truncated to %d events (limit of %zu bytes).\n", uid_str, rb.entries, rb.limit);
                     }
-                    free(namelist);
-                    strcat(temp_response, "\n");
-                    strcpy(response_buffer, temp_response);
                     if (verbose) printf("Verbose: Sent list of created events for user %s.\n", uid_str);
                 }
             }
@@ -180,94 +204,158 @@ void process_udp_request(int udp_fd, struct sockaddr_in *client_addr, char *buff
         // myreservations (LMR/RMR)
         } else if (strcmp(command, "LMR") == 0) {
             if (sscanf(buffer, "%*s %6s %8s", uid_str, password_str) != 2) {
-                snprintf(response_buffer, sizeof(response_buffer), "RMR NLG\n");
+                snprintf(response_buffer, response_size, "RMR NLG\n");
                 if (verbose) printf("Verbose: LMR failed. Reason: Request from a non-logged-in client.\n");
             
             } else if (!is_valid_uid(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RMR ERR\n");
+                snprintf(response_buffer, response_size, "RMR ERR\n");
                 if (verbose) printf("Verbose: LMR failed. Reason: Invalid UID format for '%s'.\n", uid_str);
             
             } else if (!user_exists(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RMR UNR\n");
+                snprintf(response_buffer, response_size, "RMR UNR\n");
                 if (verbose) printf("Verbose: LMR failed for %s. Reason: User not registered.\n", uid_str);
             
             } else if (!check_user_password(uid_str, password_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RMR WRP\n");
+                snprintf(response_buffer, response_size, "RMR WRP\n");
                 if (verbose) printf("Verbose: LMR failed for %s. Reason: Incorrect password.\n", uid_str);
             
             } else if (!is_user_logged_in(uid_str)) {
-                snprintf(response_buffer, sizeof(response_buffer), "RMR NLG\n");
+                snprintf(response_buffer, response_size, "RMR NLG\n");
                 if (verbose) printf("Verbose: LMR failed for %s. Reason: User not logged in.\n", uid_str);
             
             } else {
-                char reserved_dir_path[64];
-                snprintf(reserved_dir_path, sizeof(reserved_dir_path), "USERS/%s/RESERVED", uid_str);
-
-                struct dirent **namelist;
-                int n = scandir(reserved_dir_path, &namelist, NULL, alphasort);
-
-                if (n <= 2) {
-                    snprintf(response_buffer, sizeof(response_buffer), "RMR NOK\n");
+                ResponseBuilder rb;
+                response_init_fixed(&rb, response_buffer, response_size, server_data->udp_response_max);
+                response_append(&rb, "RMR OK");
+                UserListing listing = { &rb, uid_str, 0 };
+                // as mais recentes primeiro, até ao limite de 50
+                int visited = for_each_user_reservation(uid_str, list_reservation_entry, &listing);
+
+                if (visited == 0) {
+                    snprintf(response_buffer, response_size, "RMR NOK\n");
                     if (verbose) printf("Verbose: User %s has no reservations.\n", uid_str);
-                    if (n > 0) {
-                        for(int i=0; i<n; i++) free(namelist[i]);
-                        free(namelist);
-                    }
-                
                 } else {
-                    char temp_response[8192] = "RMR OK";
-                    int reservations_count = 0;
-                    // obter os mais recentes, até ao limite de 50
-                    for (int i = n - 1; i >= 0 && reservations_count < 50; i--) {
-                        if (namelist[i]->d_name[0] == '.') {
-                            free(namelist[i]);
-                            continue;
-                        }
-
-                        char reservation_filepath[512];
-                        snprintf(reservation_filepath, sizeof(reservation_filepath), "%s/%s", reserved_dir_path, namelist[i]->d_name);
-                        FILE *res_file = fopen(reservation_filepath, "r");
-                        if (res_file) {
-                            char eid_str[4], res_uid[7], res_date[11], res_time[9];
-                            int num_seats;
-                            if (fscanf(res_file, "%3s %6s %d %10s %8s", eid_str, res_uid, &num_seats, res_date, res_time) == 5) {
-                                char res_info[50];
-                                snprintf(res_info, sizeof(res_info), " %s %s %s %d", eid_str, res_date, res_time, num_seats);
-                                strcat(temp_response, res_info);
-                                reservations_count++;
-                            }
-                            fclose(res_file);
-                        }
-                        free(namelist[i]);
+                    response_finish(&rb);
+                    if (rb.truncated) {
+                        STATS_ADD(&server_data->stats, list_truncated, 1);
+                        if (verbose) printf("Verbose: LMR reply for user %s truncated to %d reservations (limit of %zu bytes).\n", uid_str, rb.entries, rb.limit);
                     }
-                    free(namelist);
-                    strcat(temp_response, "\n");
-                    strcpy(response_buffer, temp_response);
                     if (verbose) printf("Verbose: Sent list of reservations for user %s.\n", uid_str);
                 }
             }
         
         } else {
-            snprintf(response_buffer, sizeof(response_buffer), "ERR\n");
+            snprintf(response_buffer, response_size, "ERR\n");
             if (verbose) printf("Verbose: Unknown or unimplemented UDP command: '%s'.\n", command);
         }
     
     } else {
-        snprintf(response_buffer, sizeof(response_buffer), "ERR\n");
+        snprintf(response_buffer, response_size, "ERR\n");
         if (verbose) printf("Verbose: UDP request syntax error. Could not parse command.\n");
     }
     
-    ssize_t sent_bytes = sendto(udp_fd, response_buffer, strlen(response_buffer), 0,
-                                (struct sockaddr*)client_addr, client_len);
-    if (sent_bytes == -1) {
-        perror("Erro ao enviar resposta UDP");
-    } else if (verbose) {
-        printf("VERBOSE: UDP response sent to %s:%d: %s", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), response_buffer);
+    return strlen(response_buffer);
+}
+
+
+/**
+ * Calcula o tamanho do cabeçalho de um CRE: termina no espaço que se segue ao Fsize.
+ * Devolve 0 se o cabeçalho ainda não estiver completo.
+ */
+static int cre_header_length(const char *buffer, size_t len) {
+    int spaces = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (buffer[i] == '\n') return i + 1;
+        if (buffer[i] == ' ' && ++spaces == CRE_HEADER_FIELDS) return i + 1;
     }
+    return 0;
 }
 
+/**
+ * Indica quantos bytes do buffer formam o cabeçalho de um pedido TCP completo.
+ * Os pedidos terminam em '\n', exceto o CRE, cujo cabeçalho é seguido pelos dados do ficheiro.
+ * Devolve 0 se ainda for necessário ler mais dados.
+ */
+int tcp_request_header_length(const char *buffer, size_t len) {
+    if (len >= 3 && strncmp(buffer, "CRE", 3) == 0) {
+        return cre_header_length(buffer, len);
+    }
+    const char *newline = memchr(buffer, '\n', len);
+    return newline != NULL ? (int)(newline - buffer) + 1 : 0;
+}
+
+/**
+ * Conclui um CRE depois de recebido o ficheiro de descrição: cria os ficheiros de metadados
+ * do evento e prepara a resposta. Se body_ok for falso, descarta o evento.
+ */
+void complete_create_request(Connection *conn, ServerState *server_data, bool body_ok, bool verbose) {
+    PendingCreate *create = &conn->create;
+    char *response_buffer = conn->out_buf;
+    int response_size = sizeof(conn->out_buf);
+    int current_eid = create->eid;
+
+    if (conn->body_fd >= 0) {
+        close(conn->body_fd);
+        conn->body_fd = -1;
+    }
+    conn->phase = CONN_WRITE_RESPONSE;
+
+    if (!body_ok) {
+        // remover o que já tinha sido criado para o evento
+        discard_event_description(current_eid, create->fname);
+
+        snprintf(response_buffer, response_size, "RCE NOK\n");
+        if (verbose) printf("Verbose: CRE failed for %s. Reason: Description file for event %03d was not fully received.\n", create->uid, current_eid);
+        return;
+    }
+
+    if (verbose) printf("Verbose: Event %03d description file '%s' received and saved.\n", current_eid, create->fname);
+
+    // metadados do evento (START_, RES_ e CREATED/ nos ficheiros); a partir daqui, o evento é consultado na tabela em memória
+    if (!add_event(current_eid, create->uid, create->name, create->fname, create->full_date, create->attendance_size)) {
+        fprintf(stderr, "Failed to store event %03d.\n", current_eid);
+        discard_event_description(current_eid, create->fname);
+        snprintf(response_buffer, response_size, "RCE NOK\n");
+        if (verbose) printf("Verbose: CRE failed for %s. Reason: Server failed to store event %03d.\n", create->uid, current_eid);
+        return;
+    }
+
+    snprintf(response_buffer, response_size, "RCE OK %03d\n", current_eid);
+    if (verbose) printf("Verbose: Event %03d created successfully by user %s.\n", current_eid, create->uid);
+    if (verbose) printf("VERBOSE CRE: TCP response prepared for fd %d: %s", conn->fd, response_buffer);
+}
+
+/**
+ * Acrescenta um evento à listagem do LST; pára quando a resposta atinge o limite de tamanho
+ */
+static bool list_event_entry(const Event *event, void *ctx) {
+    ResponseBuilder *rb = ctx;
+    return response_add_entry(rb, " %03d %s %d %s", event->eid, event->name, event->state, event->date);
+}
+
+/**
+ * Reserva o próximo EID e persiste o contador (atómico entre workers)
+ */
+static int allocate_event_id(ServerState *server_data, bool verbose) {
+    pthread_mutex_lock(&server_data->eid_lock);
+    int eid = server_data->next_eid++;
+
+    if (save_next_eid(server_data->next_eid)) {
+        if (verbose) printf("Verbose: Persisted next_eid: %d.\n", server_data->next_eid);
+    } else {
+        perror("Erro ao guardar next_eid");
+    }
+    pthread_mutex_unlock(&server_data->eid_lock);
+    return eid;
+}
+
+
+void process_tcp_request(Connection *conn, ServerState *server_data, bool verbose) {
+    int client_fd = conn->fd;
+    char *tcp_buffer = conn->in_buf;
+    char *response_buffer = conn->out_buf;
+    int response_size = sizeof(conn->out_buf);
 
-void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, ServerState *server_data, bool verbose, char *response_buffer, int response_size) {
     if (verbose) {
         char command_type[4];
         // 3 primeiros caracteres para o tipo de comando
@@ -286,7 +374,7 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
         char uid[7], password[9], name[11], date[11], time[6], fname[25];
         char num_attendees_str[5];
         long fsize; 
-        int header_len = 0;
+        int header_len = cre_header_length(tcp_buffer, conn->in_len);
         
         if (sscanf(tcp_buffer, "CRE %6s %8s", uid, password) != 2 || !is_user_logged_in(uid)) {
             snprintf(response_buffer, response_size, "RCE NLG\n");
@@ -294,13 +382,14 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
         
         } else {
             char header_buffer[512];
-            strncpy(header_buffer, tcp_buffer, sizeof(header_buffer) - 1);
-            header_buffer[sizeof(header_buffer) - 1] = '\0';
+            size_t header_copy = (header_len > 0 && header_len < (int)sizeof(header_buffer)) ? (size_t)header_len : sizeof(header_buffer) - 1;
+            memcpy(header_buffer, tcp_buffer, header_copy);
+            header_buffer[header_copy] = '\0';
             
-            int num_parsed = sscanf(header_buffer, "CRE %*s %*s %10s %10s %5s %4s %24s %ld %n",
-                                    name, date, time, num_attendees_str, fname, &fsize, &header_len);
+            int num_parsed = sscanf(header_buffer, "CRE %*s %*s %10s %10s %5s %4s %24s %ld",
+                                    name, date, time, num_attendees_str, fname, &fsize);
 
-            if (num_parsed < 6) { 
+            if (num_parsed < 6 || header_len == 0 || tcp_buffer[header_len - 1] != ' ') { 
                 snprintf(response_buffer, response_size, "RCE ERR\n");
                 if (verbose) printf("Verbose: CRE failed. Reason: Invalid request syntax (missing arguments).\n");
             
@@ -312,93 +401,69 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
                 char full_date[17];
                 snprintf(full_date, sizeof(full_date), "%s %s", date, time);
 
-                if (!is_valid_event_name(name) || !is_valid_event_filename(fname) || !is_valid_datetime_format(full_date) || !is_datetime_in_the_future(full_date) || !is_valid_number_attendees(num_attendees_str)) {
+                if (!is_valid_event_name(name) || !is_valid_event_filename(fname) || !is_valid_datetime_format(full_date) || !is_datetime_in_the_future(full_date) || !is_valid_number_attendees(num_attendees_str) || fsize < 0 || fsize > MAX_FILE_SIZE) {
                     snprintf(response_buffer, response_size, "RCE NOK\n");
-                    if (verbose) printf("Verbose: CRE failed. Reason: Invalid parameter values (name, filename, date, or attendees).\n");
+                    if (verbose) printf("Verbose: CRE failed. Reason: Invalid parameter values (name, filename, date, attendees or file size).\n");
                 
                 } else {
-                    int current_eid = server_data->next_eid;
-                    int attendance_size = atoi(num_attendees_str);
-                    char event_dir_path[32];
-                    char description_dir_path[64];
-                    char event_filepath[128];
-                    
-                    // diretoria EVENTS
-                    snprintf(event_dir_path, sizeof(event_dir_path), "EVENTS/%03d", current_eid);
-                    mkdir("EVENTS", 0700);
-                    mkdir(event_dir_path, 0700);
-                    
-                    // subdiretoria DESCRIPTION
-                    snprintf(description_dir_path, sizeof(description_dir_path), "%s/DESCRIPTION", event_dir_path);
-                    mkdir(description_dir_path, 0700);
-
-                    snprintf(event_filepath, sizeof(event_filepath), "%s/%s", description_dir_path, fname);
-                    FILE *file = fopen(event_filepath, "wb");
-                    if (file == NULL) {
+                    // o EID é reservado já, para que uploads simultâneos não colidam
+                    int current_eid = allocate_event_id(server_data, verbose);
+                    PendingCreate *create = &conn->create;
+
+                    create->eid = current_eid;
+                    strcpy(create->uid, uid);
+                    strcpy(create->name, name);
+                    strcpy(create->fname, fname);
+                    strcpy(create->full_date, full_date);
+                    create->attendance_size = atoi(num_attendees_str);
+
+                    // diretorias EVENTS/<eid>/DESCRIPTION nos ficheiros; no log, todas as descrições ficam juntas
+                    if (prepare_event_description(current_eid, fname, create->file_path, sizeof(create->file_path))) {
+                        conn->body_fd = open(create->file_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+                    }
+                    if (conn->body_fd < 0) {
                         perror("Erro ao criar ficheiro do evento no servidor");
                         snprintf(response_buffer, response_size, "RCE NOK\n");
                         if (verbose) printf("Verbose: CRE failed for %s. Reason: Server failed to create event file.\n", uid);
                     
                     } else {
-                        if (header_len > 0) {
-                            long initial_data_len = bytes_read - header_len;
-                            fwrite(tcp_buffer + header_len, 1, initial_data_len, file);
-                            long remaining_bytes = fsize - initial_data_len;
-                            while (remaining_bytes > 0) {
-                                memset(tcp_buffer, 0, 1024);
-                                bytes_read = read(client_fd, tcp_buffer, 1024);
-                                if (bytes_read <= 0) break;
-
-                                size_t bytes_to_write = (bytes_read > remaining_bytes) ? remaining_bytes : bytes_read;
-                                fwrite(tcp_buffer, 1, bytes_to_write, file);
-
-                                remaining_bytes -= bytes_read;
-                            }
-                        }
-
-                        fclose(file);
-                        if (verbose) printf("Verbose: Event %03d description file '%s' received and saved.\n", current_eid, fname);
-
-                        char meta_path[256];
-                        // subdiretoria RESERVATIONS
-                        snprintf(meta_path, sizeof(meta_path), "EVENTS/%03d/RESERVATIONS", current_eid);
-                        mkdir(meta_path, 0700);
-
-                        // ficheiro START_<eid>.txt
-                        snprintf(meta_path, sizeof(meta_path), "EVENTS/%03d/START_%03d.txt", current_eid, current_eid);
-                        FILE* start_file = fopen(meta_path, "w");
-                        if (start_file) {
-                            fprintf(start_file, "%s %s %s %d %s\n", uid, name, fname, attendance_size, full_date);
-                            fclose(start_file);
+                        long initial_data_len = conn->in_len - header_len;
+                        if (initial_data_len > fsize) initial_data_len = fsize;
+                        conn->in_consumed += initial_data_len;
+                        conn->body_remaining = fsize - initial_data_len;
+
+                        // reservar já o espaço do ficheiro: um disco cheio é detetado antes de receber os dados
+                        if (fsize > 0 && fallocate(conn->body_fd, 0, 0, fsize) < 0 &&
+                            (errno == ENOSPC || errno == EDQUOT || errno == EFBIG)) {
+                            perror("Erro ao reservar espaço para o ficheiro do evento");
+                            if (verbose) printf("Verbose: CRE failed for %s. Reason: Not enough disk space for %ld bytes.\n", uid, fsize);
+                            conn_finish_body(conn, server_data, false, verbose);
+                            return;
                         }
 
-                        // ficheiro RES_<eid>.txt
-                        snprintf(meta_path, sizeof(meta_path), "EVENTS/%03d/RES_%03d.txt", current_eid, current_eid);
-                        FILE* res_file = fopen(meta_path, "w");
-                        if (res_file) {
-                            fprintf(res_file, "0\n");
-                            fclose(res_file);
+                        // os dados do ficheiro que já chegaram com o cabeçalho são escritos de imediato
+                        bool write_ok = true;
+                        long written = 0;
+                        while (written < initial_data_len) {
+                            ssize_t w = write(conn->body_fd, tcp_buffer + header_len + written, initial_data_len - written);
+                            if (w < 0) {
+                                if (errno == EINTR) continue;
+                                perror("Erro ao escrever ficheiro do evento no servidor");
+                                write_ok = false;
+                                break;
+                            }
+                            written += w;
                         }
+                        conn->body_offset = written;
 
-                        // ficheiro em USERS/<uid>/CREATED/
-                        snprintf(meta_path, sizeof(meta_path), "USERS/%s/CREATED/%03d.txt", uid, current_eid);
-                        FILE* created_file = fopen(meta_path, "w");
-                        if (created_file) fclose(created_file);
-
-                        snprintf(response_buffer, response_size, "RCE OK %03d\n", current_eid);
-                        if (verbose) printf("Verbose: Event %03d created successfully by user %s.\n", current_eid, uid);
-                        server_data->next_eid++;
-
-                        char eid_file_path[64];
-                        snprintf(eid_file_path, sizeof(eid_file_path), "EVENTS/eid.dat");
-                        FILE *eid_file = fopen(eid_file_path, "w");
-                        if (eid_file != NULL) {
-                            fprintf(eid_file, "%d", server_data->next_eid);
-                            fclose(eid_file);
-                            if (verbose) printf("Verbose: Persisted next_eid: %d.\n", server_data->next_eid);
+                        if (!write_ok || conn->body_remaining == 0) {
+                            conn_finish_body(conn, server_data, write_ok, verbose);
                         } else {
-                            perror("Erro ao guardar next_eid em EVENTS/eid.dat");
+                            // o resto do ficheiro é recebido pelo loop de eventos, sem bloquear o servidor
+                            conn->phase = CONN_READ_BODY;
+                            if (verbose) printf("Verbose: Receiving description file for event %03d (%ld bytes remaining).\n", current_eid, conn->body_remaining);
                         }
+                        return;
                     }
                 }
             }
@@ -408,69 +473,32 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
     
     // list (LST/RLS)
     } else if (strncmp(tcp_buffer, "LST", 3) == 0) {
-        struct dirent **namelist;
-        int n;
-
-        // lista ordenada de entradas
-        n = scandir("EVENTS", &namelist, NULL, alphasort);
-        if (n < 0) {
-            perror("scandir");
+        if (event_count() == 0) {
             snprintf(response_buffer, response_size, "RLS NOK\n");
-            if (verbose) printf("VERBOSE LST: TCP response prepared for fd %d: RLS NOK\n", client_fd);
+            if (verbose) printf("Verbose: LST failed. Reason: No events found to list.\n");
+            if (verbose) printf("VERBOSE LST: TCP response sent to fd %d: RLS NOK\n", client_fd);
             return;
         }
 
-        char full_response[8192] = "RLS OK";
-        bool found_any_event = false;
-
-        for (int i = 0; i < n; i++) {
-            if (namelist[i]->d_name[0] == '.') {
-                free(namelist[i]);
-                continue;
-            }
-
-            int eid = atoi(namelist[i]->d_name);
-            if (eid > 0) {
-                char start_path[256];
-                snprintf(start_path, sizeof(start_path), "EVENTS/%03d/START_%03d.txt", eid, eid);
-                
-                FILE* start_file = fopen(start_path, "r");
-                if (start_file) {
-                    found_any_event = true;
-                    char owner_uid[7], event_name[11], desc_fname[25], event_date_str[11], event_time_str[6];
-                    int total_seats;
-                    if (fscanf(start_file, "%6s %10s %24s %d %10s %5s", owner_uid, event_name, desc_fname, &total_seats, event_date_str, event_time_str) == 6) {
-                        char current_eid_str[12];
-                        snprintf(current_eid_str, sizeof(current_eid_str), "%03d", eid);
-                        char full_event_date[17];
-                        snprintf(full_event_date, sizeof(full_event_date), "%s %s", event_date_str, event_time_str);
-                        int state = get_event_state(current_eid_str);
-                        
-                        char temp_event_line[128];
-                        snprintf(temp_event_line, sizeof(temp_event_line), " %03d %s %d %s", eid, event_name, state, full_event_date);
-                        strcat(full_response, temp_event_line);
-                    }
-                    fclose(start_file);
-                }
-            }
-            free(namelist[i]);
-        }
+        // a listagem não cabe em out_buf: é construída à parte e colocada diretamente na fila de saída
+        ResponseBuilder rb;
+        response_init_dynamic(&rb, server_data->list_response_max);
+        response_append(&rb, "RLS OK");
+        for_each_event(list_event_entry, &rb);
 
-        if (!found_any_event) {
+        if (response_finish(&rb) == 0 || !conn_enqueue(conn, server_data, rb.data, rb.len)) {
             snprintf(response_buffer, response_size, "RLS NOK\n");
-            if (verbose) printf("Verbose: LST failed. Reason: No events found to list.\n");
-            if (verbose) printf("VERBOSE LST: TCP response sent to fd %d: RLS NOK\n", client_fd);
-        
+            fprintf(stderr, "Out of memory for LST response (fd: %d).\n", client_fd);
+
         } else {
-            strcat(full_response, "\n");
-            strncpy(response_buffer, full_response, response_size - 1);
-            if (verbose) {
-                full_response[strcspn(full_response, "\n")] = 0;
-                printf("VERBOSE LST: TCP response sent to fd %d: %s\n", client_fd, full_response);
+            if (rb.truncated) {
+                STATS_ADD(&server_data->stats, list_truncated, 1);
+                if (verbose) printf("Verbose: LST reply truncated to %d events (limit of %zu bytes).\n", rb.entries, rb.limit);
             }
+            if (verbose) printf("VERBOSE LST: TCP response sent to fd %d: RLS OK with %d events (%zu bytes)\n", client_fd, rb.entries, rb.len);
         }
 
-        free(namelist);
+        response_free(&rb);
         return;
     
     // close (CLS/RCL)
@@ -491,66 +519,48 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
                 if (verbose) printf("Verbose: CLS failed for %s. Reason: Incorrect password.\n", uid);
             
             } else {
-                char event_dir_path[32];
-                snprintf(event_dir_path, sizeof(event_dir_path), "EVENTS/%s", eid_str);
-
-                struct stat st;
-                if (stat(event_dir_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                Event event;
+                if (!is_valid_eid(eid_str) || !get_event(atoi(eid_str), &event)) {
                     snprintf(response_buffer, response_size, "RCL NOE\n");
                     if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event does not exist.\n", eid_str);
-                
+
+                } else if (strcmp(event.owner_uid, uid) != 0) {
+                    snprintf(response_buffer, response_size, "RCL EOW\n");
+                    if (verbose) printf("Verbose: CLS failed for EID %s. Reason: User %s is not the owner.\n", eid_str, uid);
+
                 } else {
-                    char start_path[64];
-                    snprintf(start_path, sizeof(start_path), "%s/START_%s.txt", event_dir_path, eid_str);
-                    FILE *start_file = fopen(start_path, "r");
-                    if (!start_file) {
-                        snprintf(response_buffer, response_size, "RCL NOE\n");
-                        if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event doesn't exist or data is corrupted (missing START file).\n", eid_str);
-                    
-                    } else {
-                        char owner_uid[7];
-                        if (fscanf(start_file, "%6s", owner_uid) != 1) {
-                            snprintf(response_buffer, response_size, "RCL NOE\n");
-                            if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event doesn't exist or data is corrupted (malformed START file).\n", eid_str);
-                            fclose(start_file);
-                        
-                        } else {
-                            fclose(start_file);
-                            if (strcmp(owner_uid, uid) != 0) {
-                                snprintf(response_buffer, response_size, "RCL EOW\n");
-                                if (verbose) printf("Verbose: CLS failed for EID %s. Reason: User %s is not the owner.\n", eid_str, uid);
-                            
+                    // o estado não pode mudar (reserva ou fecho noutro worker) entre a verificação e o fecho
+                    pthread_mutex_lock(&server_data->reservation_lock);
+                    EventState state = get_event_state(event.eid);
+
+                    switch (state) {
+                        case CLOSED:
+                            snprintf(response_buffer, response_size, "RCL CLO\n");
+                            if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event already closed.\n", eid_str);
+                            break;
+                        case PAST:
+                            snprintf(response_buffer, response_size, "RCL PST\n");
+                            if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event already in the past.\n", eid_str);
+                            break;
+                        case SOLD_OUT:
+                            snprintf(response_buffer, response_size, "RCL SLD\n");
+                            if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event is sold out.\n", eid_str);
+                            break;
+                        case ACTIVE:
+                            if (close_event(event.eid)) {
+                                snprintf(response_buffer, response_size, "RCL OK\n");
+                                if (verbose) printf("Verbose: Event %s closed successfully by owner %s.\n", eid_str, uid);
                             } else {
-                                EventState state = get_event_state(eid_str);
-
-                                switch (state) {
-                                    case CLOSED:
-                                        snprintf(response_buffer, response_size, "RCL CLO\n");
-                                        if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event already closed.\n", eid_str);
-                                        break;
-                                    case PAST:
-                                        snprintf(response_buffer, response_size, "RCL PST\n");
-                                        // se o evento já passou, criar o ficheiro END_
-                                        create_end_file(eid_str);
-                                        if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event already in the past.\n", eid_str);
-                                        break;
-                                    case SOLD_OUT:
-                                        snprintf(response_buffer, response_size, "RCL SLD\n");
-                                        if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Event is sold out.\n", eid_str);
-                                        break;
-                                    case ACTIVE:
-                                        create_end_file(eid_str);
-                                        snprintf(response_buffer, response_size, "RCL OK\n");
-                                        if (verbose) printf("Verbose: Event %s closed successfully by owner %s.\n", eid_str, uid);
-                                        break;
-                                    default:
-                                        snprintf(response_buffer, response_size, "RCL ERR\n");
-                                        if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Unknown event state.\n", eid_str);
-                                        break;
-                                }
+                                snprintf(response_buffer, response_size, "RCL ERR\n");
+                                if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Server failed to store the event end.\n", eid_str);
                             }
-                        }
+                            break;
+                        default:
+                            snprintf(response_buffer, response_size, "RCL ERR\n");
+                            if (verbose) printf("Verbose: CLS failed for EID %s. Reason: Unknown event state.\n", eid_str);
+                            break;
                     }
+                    pthread_mutex_unlock(&server_data->reservation_lock);
                 }
             }
         }
@@ -577,17 +587,16 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
                 if (verbose) printf("Verbose: RID failed for %s. Reason: Incorrect password.\n", uid);
             
             } else {
-                char event_dir_path[32];
-                snprintf(event_dir_path, sizeof(event_dir_path), "EVENTS/%s", eid_str);
-
-                struct stat st;
-                if (stat(event_dir_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                Event event;
+                if (!is_valid_eid(eid_str) || !get_event(atoi(eid_str), &event)) {
                     snprintf(response_buffer, response_size, "RRI NOK\n");
                     if (verbose) printf("Verbose: RID failed for EID %s. Reason: Event isn't active or doesn't exist.\n", eid_str);
                 
                 } else {
-                    EventState state = get_event_state(eid_str);
-                    switch (state) {
+                    // leitura-modificação-escrita do número de lugares reservados atómica entre workers
+                    pthread_mutex_lock(&server_data->reservation_lock);
+                    get_event(event.eid, &event);
+                    switch (event.state) {
                         case CLOSED:
                             snprintf(response_buffer, response_size, "RRI CLS\n");
                             if (verbose) printf("Verbose: RID failed for EID %s. Reason: Event is closed.\n", eid_str);
@@ -601,68 +610,19 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
                             if (verbose) printf("Verbose: RID failed for EID %s. Reason: Event is sold out.\n", eid_str);
                             break;
                         case ACTIVE: {
-                            char start_path[64], res_path[64];
-                            snprintf(start_path, sizeof(start_path), "%s/START_%s.txt", event_dir_path, eid_str);
-                            snprintf(res_path, sizeof(res_path), "%s/RES_%s.txt", event_dir_path, eid_str);
-
-                            FILE *start_file = fopen(start_path, "r");
-                            FILE *res_file = fopen(res_path, "r");
-
-                            if (!start_file || !res_file) {
-                                snprintf(response_buffer, response_size, "RRI ERR\n");
-                                if (verbose) printf("Verbose: RID failed for EID %s. Reason: Server data corruption (missing START/RES file).\n", eid_str);
+                            int reserved_seats = event.reserved_seats;
+                            int available_seats = event.total_seats - reserved_seats;
+                            if (seats_to_reserve > available_seats) {
+                                snprintf(response_buffer, response_size, "RRI REJ %d\n", available_seats);
+                                if (verbose) printf("Verbose: RID rejected for EID %s. Reason: Not enough seats (requested %d, available %d).\n", eid_str, seats_to_reserve, available_seats);
                             
+                            } else if (!record_reservation(event.eid, uid, seats_to_reserve, reserved_seats + seats_to_reserve)) {
+                                snprintf(response_buffer, response_size, "RRI ERR\n");
+                                if (verbose) printf("Verbose: RID failed for EID %s. Reason: Server failed to store the reservation.\n", eid_str);
+
                             } else {
-                                int total_seats, reserved_seats;
-                                fscanf(start_file, "%*s %*s %*s %d", &total_seats);
-                                fscanf(res_file, "%d", &reserved_seats);
-                                fclose(start_file);
-                                fclose(res_file);
-
-                                int available_seats = total_seats - reserved_seats;
-                                if (seats_to_reserve > available_seats) {
-                                    snprintf(response_buffer, response_size, "RRI REJ %d\n", available_seats);
-                                    if (verbose) printf("Verbose: RID rejected for EID %s. Reason: Not enough seats (requested %d, available %d).\n", eid_str, seats_to_reserve, available_seats);
-                                
-                                } else {
-                                    res_file = fopen(res_path, "w");
-                                    fprintf(res_file, "%d\n", reserved_seats + seats_to_reserve);
-                                    fclose(res_file);
-
-                                    // ficheiros de registo da reserva
-                                    char date_str[11], time_str[7], datetime_str[20];
-                                    get_datetime_for_filename(date_str, time_str, sizeof(date_str));
-                                    time_t now = time(NULL);
-                                    strftime(datetime_str, sizeof(datetime_str), "%d-%m-%Y %H:%M:%S", localtime(&now));
-
-                                    char reservation_filename[128];
-                                    snprintf(reservation_filename, sizeof(reservation_filename), "R-%s-%s_%s.txt", uid, date_str, time_str);
-
-                                    char event_res_path[256], user_res_path[256];
-                                    snprintf(event_res_path, sizeof(event_res_path), "%s/RESERVATIONS/%s", event_dir_path, reservation_filename);
-                                    snprintf(user_res_path, sizeof(user_res_path), "USERS/%s/RESERVED/%s", uid, reservation_filename);
-
-                                    FILE *event_res_file = fopen(event_res_path, "w");
-                                    FILE *user_res_file = fopen(user_res_path, "w");
-
-                                    if (event_res_file && user_res_file) {
-                                        fprintf(event_res_file, "%s %s %d %s\n", eid_str, uid, seats_to_reserve, datetime_str);
-                                        fprintf(user_res_file, "%s %s %d %s\n", eid_str, uid, seats_to_reserve, datetime_str);
-                                        snprintf(response_buffer, response_size, "RRI ACC\n");
-                                        if (verbose) printf("Verbose: Reservation for %d seats on event %s by user %s accepted.\n", seats_to_reserve, eid_str, uid);
-                                    
-                                    } else {
-                                        snprintf(response_buffer, response_size, "RRI ERR\n");
-                                        if (verbose) printf("Verbose: RID failed for EID %s. Reason: Server failed to create reservation files.\n", eid_str);
-                                        FILE* revert_res_file = fopen(res_path, "w");
-                                        if (revert_res_file) {
-                                            fprintf(revert_res_file, "%d\n", reserved_seats);
-                                            fclose(revert_res_file);
-                                        }
-                                    }
-                                    if (event_res_file) fclose(event_res_file);
-                                    if (user_res_file) fclose(user_res_file);
-                                }
+                                snprintf(response_buffer, response_size, "RRI ACC\n");
+                                if (verbose) printf("Verbose: Reservation for %d seats on event %s by user %s accepted.\n", seats_to_reserve, eid_str, uid);
                             }
                             break;
                         }
@@ -671,6 +631,7 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
                             if (verbose) printf("Verbose: RID failed for EID %s. Reason: Unknown event state.\n", eid_str);
                             break;
                     }
+                    pthread_mutex_unlock(&server_data->reservation_lock);
                 }
             }
         }
@@ -718,72 +679,39 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
     } else if (strncmp(tcp_buffer, "SED", 3) == 0) {
         char eid_str[4];
         if (sscanf(tcp_buffer, "SED %3s", eid_str) == 1) {
-            char event_dir_path[32];
-            snprintf(event_dir_path, sizeof(event_dir_path), "EVENTS/%s", eid_str);
-            
-            struct stat st;
-            if (stat(event_dir_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            Event event;
+            if (!is_valid_eid(eid_str) || !get_event(atoi(eid_str), &event)) {
                 snprintf(response_buffer, response_size, "RSE NOK\n");
                 if (verbose) printf("Verbose: SED failed for EID %s. Reason: Event does not exist.\n", eid_str);
                 if (verbose) printf("VERBOSE SED: TCP response sent to fd %d: RSE NOK\n", client_fd);
             
             } else {
-                char start_path[64], res_path[64];
-                snprintf(start_path, sizeof(start_path), "%s/START_%s.txt", event_dir_path, eid_str);
-                snprintf(res_path, sizeof(res_path), "%s/RES_%s.txt", event_dir_path, eid_str);
-                
-                FILE *start_file = fopen(start_path, "r");
-                FILE *res_file = fopen(res_path, "r");
+                char desc_file_path[128];
+                event_description_path(event.eid, event.filename, desc_file_path, sizeof(desc_file_path));
 
-                if (!start_file || !res_file) {
+                struct stat st;
+                if (stat(desc_file_path, &st) != 0) {
                     snprintf(response_buffer, response_size, "RSE NOK\n");
-                    if (verbose) printf("Verbose: SED failed for EID %s. Reason: Server data corruption (missing START/RES file).\n", eid_str);
-                    if (start_file) fclose(start_file);
-                    if (res_file) fclose(res_file);
+                    if (verbose) printf("Verbose: SED failed for EID %s. Reason: Description file is missing.\n", eid_str);
                 
                 } else {
-                    char owner_uid[7], name[11], fname[25], date[11], time[6];
-                    int total_seats, reserved_seats = 0;
-
-                    fscanf(start_file, "%6s %10s %24s %d %10s %5s", owner_uid, name, fname, &total_seats, date, time);
-                    fscanf(res_file, "%d", &reserved_seats);
-                    fclose(start_file);
-                    fclose(res_file);
-
-                    char desc_file_path[128];
-                    snprintf(desc_file_path, sizeof(desc_file_path), "%s/DESCRIPTION/%s", event_dir_path, fname);
+                    long fsize = st.st_size;
+                    snprintf(response_buffer, response_size, "RSE OK %s %s %s %d %d %s %ld ",
+                             event.owner_uid, event.name, event.date, event.total_seats, event.reserved_seats, event.filename, fsize);
+                    if (verbose) {
+                        printf("VERBOSE SED: TCP response header prepared for fd %d: %s\n", client_fd, response_buffer);
+                    }
 
-                    if (stat(desc_file_path, &st) != 0) {
+                    // o ficheiro é enviado pelo loop de eventos a seguir ao cabeçalho
+                    conn->file_fd = open(desc_file_path, O_RDONLY);
+                    if (conn->file_fd < 0) {
+                        perror("Erro ao abrir ficheiro de descrição");
                         snprintf(response_buffer, response_size, "RSE NOK\n");
-                        if (verbose) printf("Verbose: SED failed for EID %s. Reason: Description file is missing.\n", eid_str);
-                    
                     } else {
-                        long fsize = st.st_size;
-                        char full_date[17];
-                        snprintf(full_date, sizeof(full_date), "%s %s", date, time);
-
-                        snprintf(response_buffer, response_size, "RSE OK %s %s %s %d %d %s %ld ",
-                                 owner_uid, name, full_date, total_seats, reserved_seats, fname, fsize);
-                        if (verbose) {
-                            printf("VERBOSE SED: TCP response header prepared for fd %d: %s\n", client_fd, response_buffer);
-                        }
-                        ssize_t header_bytes_sent = write(client_fd, response_buffer, strlen(response_buffer));
-                        
-                        if (header_bytes_sent > 0) {
-                            FILE *desc_file = fopen(desc_file_path, "rb");
-                            if (desc_file) {
-                                char file_buffer[1024];
-                                size_t bytes_read_from_file;
-                                while ((bytes_read_from_file = fread(file_buffer, 1, sizeof(file_buffer), desc_file)) > 0) {
-                                    if (write(client_fd, file_buffer, bytes_read_from_file) == -1) {
-                                        break;
-                                    }
-                                }
-                                fclose(desc_file);
-                            }
-                        }
-                        return;
+                        conn->file_remaining = fsize;
+                        conn->phase = CONN_SEND_FILE;
                     }
+                    return;
                 }
             }
         
@@ -793,6 +721,19 @@ void process_tcp_request(int client_fd, char *tcp_buffer, ssize_t bytes_read, Se
         }
         return;
     
+    // keep-alive (KAL/RKA): a conexão passa a aceitar vários pedidos seguidos
+    } else if (strncmp(tcp_buffer, "KAL", 3) == 0) {
+        if (server_data->keepalive_max_requests <= 1) {
+            snprintf(response_buffer, response_size, "RKA NOK\n");
+            if (verbose) printf("Verbose: KAL refused for fd %d. Reason: Persistent connections are disabled.\n", client_fd);
+        } else {
+            conn->keep_alive = true;
+            snprintf(response_buffer, response_size, "RKA OK %d %d\n", server_data->keepalive_max_requests, server_data->idle_timeout);
+            if (verbose) printf("Verbose: Connection fd %d is now persistent (max %d requests, idle timeout %ds).\n",
+                                client_fd, server_data->keepalive_max_requests, server_data->idle_timeout);
+        }
+        return;
+
     } else {
         snprintf(response_buffer, response_size, "ERR\n");
         if (verbose) printf("Verbose: Unknown TCP command received.\n");
@@ -2,13 +2,23 @@
 #define SERVER_LOGIC_H
 
 #include "structures.h"
+#include "connection.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
 
-// Processa um pedido UDP completo
-void process_udp_request(int udp_fd, struct sockaddr_in *client_addr, char *buffer, ServerState *server_data, bool verbose);
+// Tamanho máximo de uma resposta UDP
+#define UDP_RESPONSE_MAX 8192
 
-// Processa um pedido TCP completo
-void process_tcp_request(int client_fd, char *buffer, ssize_t buffer_size, ServerState *server_data, bool verbose, char *response_buffer, int response_size);
+// Processa um pedido UDP completo, escrevendo a resposta em response_buffer; devolve o seu tamanho
+size_t process_udp_request(struct sockaddr_in *client_addr, char *buffer, char *response_buffer, size_t response_size, ServerState *server_data, bool verbose);
+
+// Indica o tamanho do cabeçalho de um pedido TCP completo (0 se incompleto)
+int tcp_request_header_length(const char *buffer, size_t len);
+
+// Processa o cabeçalho de um pedido TCP, preparando a resposta ou a fase seguinte da conexão
+void process_tcp_request(Connection *conn, ServerState *server_data, bool verbose);
+
+// Conclui um CRE depois de recebido (ou abortado) o upload do ficheiro de descrição
+void complete_create_request(Connection *conn, ServerState *server_data, bool body_ok, bool verbose);
 
 #endif
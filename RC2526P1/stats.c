@@ -0,0 +1,63 @@
+#include "stats.h"
+#include <signal.h>
+
+// Pedido de impressão das estatísticas, feito a partir do handler de sinal
+static volatile sig_atomic_t print_requested = 0;
+
+/**
+ * Atualiza um contador de máximo, repetindo a troca se outro worker o alterar entretanto
+ */
+void stats_update_max(unsigned long *counter, unsigned long value) {
+    unsigned long current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > current) {
+        if (__atomic_compare_exchange_n(counter, &current, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static unsigned long stats_load(unsigned long *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * Imprime os contadores do servidor
+ */
+void stats_print(ServerStats *stats, FILE *out) {
+    unsigned long batches = stats_load(&stats->udp_batches);
+    unsigned long datagrams = stats_load(&stats->udp_batch_datagrams);
+
+    fprintf(out, "=== Estatísticas do ES ===\n");
+    fprintf(out, "UDP em lote: %lu lotes, %lu datagramas, média %.2f por lote, %lu lotes cheios, máximo %lu\n",
+            batches, datagrams, batches > 0 ? (double)datagrams / batches : 0.0,
+            stats_load(&stats->udp_batch_full), stats_load(&stats->udp_batch_max));
+    fprintf(out, "SED: %lu bytes com sendfile, %lu bytes com splice, %lu bytes copiados\n",
+            stats_load(&stats->sed_sendfile_bytes), stats_load(&stats->sed_splice_bytes), stats_load(&stats->sed_copy_bytes));
+    fprintf(out, "CRE: %lu bytes com splice, %lu bytes copiados\n",
+            stats_load(&stats->cre_splice_bytes), stats_load(&stats->cre_copy_bytes));
+    fprintf(out, "TCP: %lu bytes em fila, maior fila %lu bytes, %lu pausas na leitura por contrapressão\n",
+            stats_load(&stats->tcp_bytes_queued), stats_load(&stats->tcp_queue_peak), stats_load(&stats->tcp_reads_paused));
+    fprintf(out, "Listagens truncadas pelo limite de tamanho: %lu\n", stats_load(&stats->list_truncated));
+    fprintf(out, "Log: %lu registos (%lu bytes), %lu fsyncs, %lu snapshots\n",
+            stats_load(&stats->store_records), stats_load(&stats->store_bytes),
+            stats_load(&stats->store_syncs), stats_load(&stats->store_snapshots));
+    fflush(out);
+}
+
+/**
+ * Handler de SIGUSR1 (apenas marca o pedido, a impressão é feita fora do handler)
+ */
+void stats_request_print(int signum) {
+    (void)signum;
+    print_requested = 1;
+}
+
+/**
+ * Imprime as estatísticas se tiver chegado um SIGUSR1 desde a última verificação
+ */
+void stats_print_if_requested(ServerStats *stats) {
+    if (print_requested) {
+        print_requested = 0;
+        stats_print(stats, stdout);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/*
+ * Contadores de desempenho do servidor, partilhados por todos os workers.
+ * São atualizados com operações atómicas e impressos ao receber SIGUSR1.
+ */
+typedef struct ServerStats {
+    // receção UDP em lote (recvmmsg/sendmmsg)
+    unsigned long udp_batches;
+    unsigned long udp_batch_datagrams;
+    unsigned long udp_batch_full;
+    unsigned long udp_batch_max;
+
+    // bytes de ficheiros de descrição enviados (SED) por cada mecanismo
+    unsigned long sed_sendfile_bytes;
+    unsigned long sed_splice_bytes;
+    unsigned long sed_copy_bytes;
+
+    // bytes de ficheiros de descrição recebidos (CRE) por cada mecanismo
+    unsigned long cre_splice_bytes;
+    unsigned long cre_copy_bytes;
+
+    // filas de saída TCP: bytes colocados em fila, maior fila observada e pausas na leitura por contrapressão
+    unsigned long tcp_bytes_queued;
+    unsigned long tcp_queue_peak;
+    unsigned long tcp_reads_paused;
+
+    // respostas com listas (LST, LME, LMR) cortadas pelo limite de tamanho
+    unsigned long list_truncated;
+
+    // armazenamento em log: registos e bytes escritos, fsyncs (cada um partilhado pelos registos do intervalo) e snapshots
+    unsigned long store_records;
+    unsigned long store_bytes;
+    unsigned long store_syncs;
+    unsigned long store_snapshots;
+} ServerStats;
+
+// Incrementa um contador de forma atómica
+#define STATS_ADD(stats, field, value) __atomic_fetch_add(&(stats)->field, (value), __ATOMIC_RELAXED)
+
+// Atualiza um contador de máximo de forma atómica
+void stats_update_max(unsigned long *counter, unsigned long value);
+
+// Imprime todos os contadores
+void stats_print(ServerStats *stats, FILE *out);
+
+// Handler de SIGUSR1: pede a impressão das estatísticas
+void stats_request_print(int signum);
+
+// Imprime as estatísticas se tiver sido pedido (chamado pelos loops de eventos)
+void stats_print_if_requested(ServerStats *stats);
+
+#endif
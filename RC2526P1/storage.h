@@ -0,0 +1,60 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "structures.h"
+#include <stddef.h>
+
+/*
+ * Motor de armazenamento: a forma como o estado dos utilizadores, eventos e reservas é guardado em disco.
+ * O data_manager mantém esse estado em memória e chama o motor para cada alteração (escrita antes
+ * de a alteração ficar visível em memória) e, no arranque, para o carregar.
+ *
+ * Existem dois motores, escolhidos no arranque do servidor (-S):
+ * - files: a estrutura original de diretorias e pequenos ficheiros em USERS/ e EVENTS/;
+ * - log: um único log binário só de acrescento em STORE/, com fsync em grupo, snapshots e compactação.
+ */
+
+// Chamado no arranque para cada utilizador guardado
+typedef void (*UserLoader)(const char *uid, bool registered, bool logged_in, const char *password);
+
+// Chamado no arranque para cada evento guardado (com o estado já determinado)
+typedef bool (*EventLoader)(const Event *event);
+
+// Percorre as reservas de um utilizador, da mais recente para a mais antiga, até devolver false
+typedef bool (*ReservationVisitor)(const Reservation *reservation, void *ctx);
+
+typedef struct StorageEngine {
+    const char *name;
+
+    // Prepara o armazenamento (diretorias, recuperação do log); devolve false em caso de erro
+    bool (*open)(ServerStats *stats, bool verbose);
+    void (*close)(void);
+
+    // Carregamento do estado no arranque (devolvem o número de registos, ou -1 em caso de erro)
+    int (*load_users)(UserLoader loader);
+    int (*load_events)(EventLoader loader);
+    int (*load_next_eid)(void);
+
+    // Utilizadores
+    bool (*create_user)(const char *uid, const char *password);
+    bool (*set_login)(const char *uid, bool logged_in);
+    bool (*set_password)(const char *uid, const char *password);
+    bool (*remove_user)(const char *uid);
+
+    // Eventos e reservas
+    bool (*save_next_eid)(int next_eid);
+    bool (*create_event)(const Event *event);
+    bool (*add_reservation)(const Reservation *reservation, int reserved_seats);
+    bool (*end_event)(int eid, EventState state);
+    int (*list_reservations)(const char *uid, ReservationVisitor visit, void *ctx);
+
+    // Ficheiros de descrição dos eventos (continuam a ser ficheiros normais, enviados com sendfile)
+    bool (*prepare_description)(int eid, const char *filename, char *path, size_t size);
+    void (*discard_description)(int eid, const char *filename);
+    void (*description_path)(int eid, const char *filename, char *path, size_t size);
+} StorageEngine;
+
+extern const StorageEngine files_storage;
+extern const StorageEngine log_storage;
+
+#endif
@@ -0,0 +1,400 @@
+#include "storage.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+
+/*
+ * Motor de armazenamento original: cada utilizador é uma diretoria USERS/<uid>/ e cada evento
+ * uma diretoria EVENTS/<eid>/, com um pequeno ficheiro de texto por cada dado.
+ */
+
+static bool files_open(ServerStats *stats, bool verbose) {
+    (void)stats;
+    (void)verbose;
+    // as diretorias podem já existir
+    mkdir("USERS", 0700);
+    mkdir("EVENTS", 0700);
+    return true;
+}
+
+static void files_close(void) {
+}
+
+/**
+ * Percorre USERS/ e lê o ficheiro de password e o de sessão de cada utilizador
+ */
+static int files_load_users(UserLoader loader) {
+    DIR *dir = opendir("USERS");
+    if (dir == NULL) return -1;
+
+    int loaded = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_valid_uid(entry->d_name)) continue;
+        char uid[7];
+        memcpy(uid, entry->d_name, sizeof(uid));
+
+        char path[256];
+        struct stat st;
+        snprintf(path, sizeof(path), "USERS/%s", uid);
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+        char password[9] = "";
+        bool registered = false;
+        snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
+        FILE *f = fopen(path, "r");
+        if (f != NULL) {
+            char stored_password[10]; // 8 chars + \n + \0
+            if (fgets(stored_password, sizeof(stored_password), f) != NULL) {
+                stored_password[strcspn(stored_password, "\n")] = 0;
+                strncpy(password, stored_password, sizeof(password) - 1);
+            }
+            registered = true;
+            fclose(f);
+        }
+
+        snprintf(path, sizeof(path), "USERS/%s/%s_login.txt", uid, uid);
+        bool logged_in = stat(path, &st) == 0;
+
+        loader(uid, registered, logged_in, password);
+        loaded++;
+    }
+
+    closedir(dir);
+    return loaded;
+}
+
+/**
+ * Lê um evento de EVENTS/<eid>/ (START_, RES_ e END_)
+ */
+static bool read_event_files(int eid, Event *event) {
+    char path[256];
+    memset(event, 0, sizeof(*event));
+    event->eid = eid;
+
+    snprintf(path, sizeof(path), "EVENTS/%03d/START_%03d.txt", eid, eid);
+    FILE *start_file = fopen(path, "r");
+    if (start_file == NULL) return false;
+    char date_str[11], time_str[6];
+    int fields = fscanf(start_file, "%6s %10s %24s %d %10s %5s", event->owner_uid, event->name, event->filename, &event->total_seats, date_str, time_str);
+    fclose(start_file);
+    if (fields != 6) return false;
+    snprintf(event->date, sizeof(event->date), "%s %s", date_str, time_str);
+    event->event_time = datetime_to_epoch(event->date);
+
+    snprintf(path, sizeof(path), "EVENTS/%03d/RES_%03d.txt", eid, eid);
+    FILE *res_file = fopen(path, "r");
+    if (res_file == NULL) return false;
+    if (fscanf(res_file, "%d", &event->reserved_seats) != 1) event->reserved_seats = 0;
+    fclose(res_file);
+
+    event->state = event->reserved_seats >= event->total_seats ? SOLD_OUT : ACTIVE;
+
+    // END_ é escrito tanto ao fechar um evento como quando a sua data passa:
+    // a data de escrita permite distinguir os dois casos
+    snprintf(path, sizeof(path), "EVENTS/%03d/END_%03d.txt", eid, eid);
+    FILE *end_file = fopen(path, "r");
+    if (end_file != NULL) {
+        char end_date[11], end_time[9];
+        event->state = CLOSED;
+        if (fscanf(end_file, "%10s %8s", end_date, end_time) == 2) {
+            char end_datetime[20];
+            snprintf(end_datetime, sizeof(end_datetime), "%s %s", end_date, end_time);
+            if (datetime_to_epoch(end_datetime) >= event->event_time) event->state = PAST;
+        }
+        fclose(end_file);
+    }
+    return true;
+}
+
+/**
+ * Percorre EVENTS/ e lê os ficheiros de cada evento
+ */
+static int files_load_events(EventLoader loader) {
+    DIR *dir = opendir("EVENTS");
+    if (dir == NULL) return -1;
+
+    int loaded = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int eid = atoi(entry->d_name);
+        if (eid <= 0) continue;
+
+        // eventos com o upload por concluir (sem START_) são ignorados, como antes
+        Event event;
+        if (!read_event_files(eid, &event)) continue;
+        if (!loader(&event)) break;
+        loaded++;
+    }
+    closedir(dir);
+    return loaded;
+}
+
+/**
+ * Lê o próximo EID de EVENTS/eid.dat (1 se o ficheiro não existir)
+ */
+static int files_load_next_eid(void) {
+    FILE *eid_file = fopen("EVENTS/eid.dat", "r");
+    if (eid_file == NULL) return 1;
+
+    int next_eid;
+    if (fscanf(eid_file, "%d", &next_eid) != 1 || next_eid <= 0) {
+        fprintf(stderr, "Erro ao ler next_eid de EVENTS/eid.dat. A usar 1.\n");
+        next_eid = 1;
+    }
+    fclose(eid_file);
+    return next_eid;
+}
+
+/**
+ * Escreve um ficheiro de texto com uma linha (substituindo o conteúdo anterior)
+ */
+static bool write_line_file(const char *path, const char *line) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return false;
+    fprintf(f, "%s\n", line);
+    return fclose(f) == 0;
+}
+
+/**
+ * Cria a estrutura de ficheiros para um novo utilizador
+ */
+static bool files_create_user(const char *uid, const char *password) {
+    char path[256];
+
+    // diretoria USERS/<uid>
+    snprintf(path, sizeof(path), "USERS/%s", uid);
+    mkdir(path, 0700);
+
+    // subdiretorias CREATED e RESERVED
+    snprintf(path, sizeof(path), "USERS/%s/CREATED", uid);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "USERS/%s/RESERVED", uid);
+    mkdir(path, 0700);
+
+    // ficheiro USERS/<uid>/<uid>_pass.txt
+    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
+    return write_line_file(path, password);
+}
+
+/**
+ * Cria ou remove o ficheiro de sessão de um utilizador
+ */
+static bool files_set_login(const char *uid, bool logged_in) {
+    char path[256];
+    snprintf(path, sizeof(path), "USERS/%s/%s_login.txt", uid, uid);
+    if (!logged_in) {
+        unlink(path);
+        return true;
+    }
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return false;
+    fclose(f);
+    return true;
+}
+
+/**
+ * Atualiza a password de um utilizador no seu ficheiro _pass.txt
+ */
+static bool files_set_password(const char *uid, const char *password) {
+    char path[256];
+    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
+    return write_line_file(path, password);
+}
+
+/**
+ * Remove os ficheiros de password e de sessão (a diretoria do utilizador mantém-se)
+ */
+static bool files_remove_user(const char *uid) {
+    char path[256];
+    snprintf(path, sizeof(path), "USERS/%s/%s_pass.txt", uid, uid);
+    unlink(path);
+    return files_set_login(uid, false);
+}
+
+/**
+ * Persiste o contador de EIDs em EVENTS/eid.dat
+ */
+static bool files_save_next_eid(int next_eid) {
+    FILE *eid_file = fopen("EVENTS/eid.dat", "w");
+    if (eid_file == NULL) return false;
+    fprintf(eid_file, "%d", next_eid);
+    return fclose(eid_file) == 0;
+}
+
+/**
+ * Escreve os ficheiros de metadados de um evento cujo ficheiro de descrição já foi recebido
+ */
+static bool files_create_event(const Event *event) {
+    char path[256];
+    int eid = event->eid;
+
+    // subdiretoria RESERVATIONS
+    snprintf(path, sizeof(path), "EVENTS/%03d/RESERVATIONS", eid);
+    mkdir(path, 0700);
+
+    // ficheiro START_<eid>.txt
+    snprintf(path, sizeof(path), "EVENTS/%03d/START_%03d.txt", eid, eid);
+    FILE *start_file = fopen(path, "w");
+    if (start_file == NULL) return false;
+    fprintf(start_file, "%s %s %s %d %s\n", event->owner_uid, event->name, event->filename, event->total_seats, event->date);
+    if (fclose(start_file) != 0) return false;
+
+    // ficheiro RES_<eid>.txt
+    snprintf(path, sizeof(path), "EVENTS/%03d/RES_%03d.txt", eid, eid);
+    if (!write_line_file(path, "0")) return false;
+
+    // ficheiro em USERS/<uid>/CREATED/
+    snprintf(path, sizeof(path), "USERS/%s/CREATED/%03d.txt", event->owner_uid, eid);
+    FILE *created_file = fopen(path, "w");
+    if (created_file) fclose(created_file);
+    return true;
+}
+
+/**
+ * Escreve o contador de lugares reservados em RES_<eid>.txt
+ */
+static bool write_res_file(int eid, int reserved_seats) {
+    char path[256], line[16];
+    snprintf(path, sizeof(path), "EVENTS/%03d/RES_%03d.txt", eid, eid);
+    snprintf(line, sizeof(line), "%d", reserved_seats);
+    return write_line_file(path, line);
+}
+
+/**
+ * Regista uma reserva: atualiza RES_<eid>.txt e cria os ficheiros da reserva no evento e no utilizador.
+ * Se os ficheiros da reserva não puderem ser criados, o contador volta ao valor anterior.
+ */
+static bool files_add_reservation(const Reservation *reservation, int reserved_seats) {
+    int eid = reservation->eid;
+    if (!write_res_file(eid, reserved_seats)) return false;
+
+    // o nome do ficheiro tem a data da reserva no formato YYYYMMDD_HHMMSS
+    int day, month, year, hour, minute, second;
+    sscanf(reservation->datetime, "%d-%d-%d %d:%d:%d", &day, &month, &year, &hour, &minute, &second);
+    char reservation_filename[128];
+    snprintf(reservation_filename, sizeof(reservation_filename), "R-%s-%04d%02d%02d_%02d%02d%02d.txt",
+             reservation->uid, year, month, day, hour, minute, second);
+
+    char event_res_path[256], user_res_path[256];
+    snprintf(event_res_path, sizeof(event_res_path), "EVENTS/%03d/RESERVATIONS/%s", eid, reservation_filename);
+    snprintf(user_res_path, sizeof(user_res_path), "USERS/%s/RESERVED/%s", reservation->uid, reservation_filename);
+
+    FILE *event_res_file = fopen(event_res_path, "w");
+    FILE *user_res_file = fopen(user_res_path, "w");
+    bool ok = event_res_file != NULL && user_res_file != NULL;
+    if (ok) {
+        fprintf(event_res_file, "%03d %s %d %s\n", eid, reservation->uid, reservation->seats, reservation->datetime);
+        fprintf(user_res_file, "%03d %s %d %s\n", eid, reservation->uid, reservation->seats, reservation->datetime);
+    }
+    if (event_res_file) fclose(event_res_file);
+    if (user_res_file) fclose(user_res_file);
+
+    if (!ok) {
+        write_res_file(eid, reserved_seats - reservation->seats);
+    }
+    return ok;
+}
+
+/**
+ * Escreve o ficheiro END_<eid>.txt com a data e hora atuais (para eventos fechados e passados)
+ */
+static bool files_end_event(int eid, EventState state) {
+    (void)state;
+    char path[256], datetime_str[20];
+    snprintf(path, sizeof(path), "EVENTS/%03d/END_%03d.txt", eid, eid);
+    format_current_datetime(datetime_str, sizeof(datetime_str));
+    return write_line_file(path, datetime_str);
+}
+
+/**
+ * Percorre as reservas de USERS/<uid>/RESERVED: os nomes dos ficheiros têm a data,
+ * pelo que a ordem alfabética inversa é da mais recente para a mais antiga
+ */
+static int files_list_reservations(const char *uid, ReservationVisitor visit, void *ctx) {
+    char reserved_dir_path[64];
+    snprintf(reserved_dir_path, sizeof(reserved_dir_path), "USERS/%s/RESERVED", uid);
+
+    struct dirent **namelist;
+    int n = scandir(reserved_dir_path, &namelist, NULL, alphasort);
+    if (n < 0) return 0;
+
+    int visited = 0;
+    bool stop = false;
+    for (int i = n - 1; i >= 0; i--) {
+        if (!stop && namelist[i]->d_name[0] != '.') {
+            char reservation_filepath[512];
+            snprintf(reservation_filepath, sizeof(reservation_filepath), "%s/%s", reserved_dir_path, namelist[i]->d_name);
+            FILE *res_file = fopen(reservation_filepath, "r");
+            if (res_file) {
+                Reservation reservation;
+                char res_date[11], res_time[9];
+                if (fscanf(res_file, "%d %6s %d %10s %8s", &reservation.eid, reservation.uid, &reservation.seats, res_date, res_time) == 5) {
+                    snprintf(reservation.datetime, sizeof(reservation.datetime), "%s %s", res_date, res_time);
+                    visited++;
+                    stop = !visit(&reservation, ctx);
+                }
+                fclose(res_file);
+            }
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+    return visited;
+}
+
+/**
+ * Cria as diretorias EVENTS/<eid>/DESCRIPTION/ e devolve o caminho do ficheiro de descrição
+ */
+static bool files_prepare_description(int eid, const char *filename, char *path, size_t size) {
+    char dir_path[64];
+    snprintf(dir_path, sizeof(dir_path), "EVENTS/%03d", eid);
+    mkdir(dir_path, 0700);
+    snprintf(dir_path, sizeof(dir_path), "EVENTS/%03d/DESCRIPTION", eid);
+    if (mkdir(dir_path, 0700) != 0 && errno != EEXIST) return false;
+    snprintf(path, size, "%s/%s", dir_path, filename);
+    return true;
+}
+
+/**
+ * Remove o que já tinha sido criado para um evento cujo upload falhou
+ */
+static void files_discard_description(int eid, const char *filename) {
+    char path[256];
+    snprintf(path, sizeof(path), "EVENTS/%03d/DESCRIPTION/%s", eid, filename);
+    unlink(path);
+    snprintf(path, sizeof(path), "EVENTS/%03d/DESCRIPTION", eid);
+    rmdir(path);
+    snprintf(path, sizeof(path), "EVENTS/%03d", eid);
+    rmdir(path);
+}
+
+static void files_description_path(int eid, const char *filename, char *path, size_t size) {
+    snprintf(path, size, "EVENTS/%03d/DESCRIPTION/%s", eid, filename);
+}
+
+const StorageEngine files_storage = {
+    .name = "files",
+    .open = files_open,
+    .close = files_close,
+    .load_users = files_load_users,
+    .load_events = files_load_events,
+    .load_next_eid = files_load_next_eid,
+    .create_user = files_create_user,
+    .set_login = files_set_login,
+    .set_password = files_set_password,
+    .remove_user = files_remove_user,
+    .save_next_eid = files_save_next_eid,
+    .create_event = files_create_event,
+    .add_reservation = files_add_reservation,
+    .end_event = files_end_event,
+    .list_reservations = files_list_reservations,
+    .prepare_description = files_prepare_description,
+    .discard_description = files_discard_description,
+    .description_path = files_description_path,
+};
@@ -0,0 +1,855 @@
+#define _GNU_SOURCE
+
+#include "storage.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Motor de armazenamento em log: todas as alterações são registos binários acrescentados ao fim
+ * de um único ficheiro (o segmento atual, STORE/log-<n>), sem criar diretorias nem ficheiros por
+ * utilizador, evento ou reserva. O estado atual é mantido também em memória por este módulo.
+ *
+ * - fsync em grupo: as escritas vão para a cache de páginas e uma thread faz um único fdatasync
+ *   por cada intervalo para todos os registos escritos entretanto.
+ * - snapshots: periodicamente (ou quando o segmento fica grande) o estado completo é escrito em
+ *   STORE/snapshot e passa-se a escrever num segmento novo.
+ * - compactação: os segmentos anteriores ao snapshot deixam de ser precisos e são apagados.
+ * No arranque, o estado é reconstruído lendo o snapshot e depois os segmentos seguintes.
+ * Os registos estão no formato binário nativo da máquina.
+ */
+
+#define STORE_DIR "STORE"
+#define DESCRIPTIONS_DIR "STORE/DESCRIPTIONS"
+#define SNAPSHOT_PATH "STORE/snapshot"
+#define SNAPSHOT_TMP_PATH "STORE/snapshot.tmp"
+#define SEGMENT_PATH_FORMAT "STORE/log-%06u"
+
+// Intervalo (ms) entre fsyncs do log: os registos escritos neste intervalo partilham um fsync
+#define LOG_SYNC_INTERVAL_MS 10
+
+// Segundos entre snapshots (só se houver alterações desde o último)
+#define LOG_SNAPSHOT_INTERVAL 60
+
+// Tamanho de segmento que antecipa o snapshot seguinte
+#define LOG_SEGMENT_MAX (64 * 1024 * 1024)
+
+// Reservas guardadas por utilizador (o LMR devolve no máximo as 50 mais recentes)
+#define RESERVATION_RING_SIZE 50
+
+// Capacidade inicial da tabela de utilizadores (potência de 2) e da tabela de eventos
+#define LOG_USERS_INITIAL_CAPACITY 1024
+#define LOG_EVENTS_INITIAL_CAPACITY 1024
+
+// Tipos de registo
+enum {
+    REC_SNAPSHOT = 1,   // início de um snapshot: primeiro segmento que não está incluído nele
+    REC_USER,           // estado completo de um utilizador
+    REC_NEXT_EID,       // contador de EIDs
+    REC_EVENT,          // estado completo de um evento
+    REC_RESERVATION     // reserva, com o novo total de lugares reservados do evento
+};
+
+/*
+ * Cabeçalho de cada registo, seguido de length bytes de dados.
+ * O checksum cobre o tipo e os dados: um registo incompleto no fim do log (escrita interrompida
+ * por uma falha) é detetado e descartado na recuperação.
+ */
+typedef struct LogRecordHeader {
+    uint32_t length;
+    uint32_t checksum;
+    uint32_t type;
+} LogRecordHeader;
+
+typedef struct LogUserRecord {
+    int32_t uid;
+    uint8_t registered;
+    uint8_t logged_in;
+    char password[9];
+} LogUserRecord;
+
+typedef struct LogReservationRecord {
+    Reservation reservation;
+    int32_t reserved_seats;     // -1 nos snapshots (o total já está no registo do evento)
+} LogReservationRecord;
+
+// Tamanho máximo dos dados de um registo
+#define LOG_MAX_PAYLOAD 256
+_Static_assert(sizeof(Event) <= LOG_MAX_PAYLOAD && sizeof(LogReservationRecord) <= LOG_MAX_PAYLOAD, "registo do log demasiado grande");
+
+/*
+ * Últimas reservas de um utilizador, da mais antiga (head) para a mais recente.
+ */
+typedef struct ReservationRing {
+    Reservation items[RESERVATION_RING_SIZE];
+    int head;
+    int len;
+} ReservationRing;
+
+typedef struct LogUser {
+    LogUserRecord record;       // uid -1 numa posição livre
+    ReservationRing *ring;      // criado na primeira reserva
+} LogUser;
+
+static struct {
+    pthread_mutex_t lock;       // protege o segmento atual e o estado em memória
+    pthread_cond_t wakeup;      // acorda a thread do log (sincronização, snapshot ou paragem)
+    pthread_cond_t sync_done;
+    int fd;
+    unsigned segment;           // número do segmento atual
+    unsigned first_segment;     // segmento mais antigo ainda necessário
+    uint64_t written;           // bytes escritos no log desde o arranque
+    uint64_t synced;            // bytes já em disco
+    bool syncing;
+    size_t segment_bytes;       // bytes no segmento atual
+    bool snapshot_requested;
+    bool running;
+    pthread_t thread;
+
+    LogUser *users;
+    size_t user_capacity;
+    size_t user_count;
+    Event *events;              // indexado pelo EID (eid 0 = posição livre)
+    int event_capacity;
+    int next_eid;
+
+    ServerStats *stats;
+    bool verbose;
+} store = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .sync_done = PTHREAD_COND_INITIALIZER,
+    .fd = -1,
+    .next_eid = 1,
+};
+
+/**
+ * Checksum FNV-1a do tipo e dos dados de um registo
+ */
+static uint32_t record_checksum(uint32_t type, const void *payload, size_t length) {
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&type;
+    for (size_t i = 0; i < sizeof(type); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = payload;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t user_hash(int uid, size_t capacity) {
+    return ((unsigned)uid * 2654435761u) & (capacity - 1);
+}
+
+/**
+ * Procura um utilizador no estado do log (com o lock adquirido)
+ */
+static LogUser *log_user_find(int uid) {
+    if (uid < 0 || store.user_capacity == 0) return NULL;
+    for (size_t i = user_hash(uid, store.user_capacity); ; i = (i + 1) & (store.user_capacity - 1)) {
+        if (store.users[i].record.uid == uid) return &store.users[i];
+        if (store.users[i].record.uid == -1) return NULL;
+    }
+}
+
+/**
+ * Devolve um utilizador, criando-o se ainda não existir (com o lock adquirido)
+ */
+static LogUser *log_user_find_or_insert(int uid) {
+    LogUser *user = log_user_find(uid);
+    if (user != NULL || uid < 0) return user;
+
+    if ((store.user_count + 1) * 10 > store.user_capacity * 7) {
+        size_t new_capacity = store.user_capacity > 0 ? store.user_capacity * 2 : LOG_USERS_INITIAL_CAPACITY;
+        LogUser *new_users = malloc(new_capacity * sizeof(LogUser));
+        if (new_users == NULL) return NULL;
+        for (size_t i = 0; i < new_capacity; i++) {
+            new_users[i].record.uid = -1;
+        }
+        for (size_t i = 0; i < store.user_capacity; i++) {
+            if (store.users[i].record.uid == -1) continue;
+            size_t j = user_hash(store.users[i].record.uid, new_capacity);
+            while (new_users[j].record.uid != -1) {
+                j = (j + 1) & (new_capacity - 1);
+            }
+            new_users[j] = store.users[i];
+        }
+        free(store.users);
+        store.users = new_users;
+        store.user_capacity = new_capacity;
+    }
+
+    size_t i = user_hash(uid, store.user_capacity);
+    while (store.users[i].record.uid != -1) {
+        i = (i + 1) & (store.user_capacity - 1);
+    }
+    user = &store.users[i];
+    memset(user, 0, sizeof(*user));
+    user->record.uid = uid;
+    store.user_count++;
+    return user;
+}
+
+/**
+ * Devolve a posição do evento eid, aumentando a tabela se for preciso (com o lock adquirido)
+ */
+static Event *log_event_slot(int eid) {
+    if (eid <= 0) return NULL;
+    if (eid >= store.event_capacity) {
+        int new_capacity = store.event_capacity > 0 ? store.event_capacity : LOG_EVENTS_INITIAL_CAPACITY;
+        while (new_capacity <= eid) {
+            new_capacity *= 2;
+        }
+        Event *new_events = realloc(store.events, new_capacity * sizeof(Event));
+        if (new_events == NULL) return NULL;
+        memset(new_events + store.event_capacity, 0, (new_capacity - store.event_capacity) * sizeof(Event));
+        store.events = new_events;
+        store.event_capacity = new_capacity;
+    }
+    return &store.events[eid];
+}
+
+static Event *log_event_find(int eid) {
+    if (eid <= 0 || eid >= store.event_capacity || store.events[eid].eid != eid) return NULL;
+    return &store.events[eid];
+}
+
+/**
+ * Acrescenta uma reserva ao anel do utilizador, substituindo a mais antiga se estiver cheio
+ */
+static bool ring_push(LogUser *user, const Reservation *reservation) {
+    if (user->ring == NULL) {
+        user->ring = calloc(1, sizeof(ReservationRing));
+        if (user->ring == NULL) return false;
+    }
+    ReservationRing *ring = user->ring;
+    if (ring->len < RESERVATION_RING_SIZE) {
+        ring->items[(ring->head + ring->len++) % RESERVATION_RING_SIZE] = *reservation;
+    } else {
+        ring->items[ring->head] = *reservation;
+        ring->head = (ring->head + 1) % RESERVATION_RING_SIZE;
+    }
+    return true;
+}
+
+/**
+ * Aplica um registo ao estado em memória (na recuperação e depois de cada escrita)
+ */
+static bool apply_record(uint32_t type, const void *payload, uint32_t length) {
+    switch (type) {
+        case REC_SNAPSHOT: {
+            if (length != sizeof(uint32_t)) return false;
+            memcpy(&store.first_segment, payload, sizeof(uint32_t));
+            return true;
+        }
+        case REC_USER: {
+            LogUserRecord record;
+            if (length != sizeof(record)) return false;
+            memcpy(&record, payload, sizeof(record));
+            LogUser *user = log_user_find_or_insert(record.uid);
+            if (user == NULL) return false;
+            user->record = record;
+            return true;
+        }
+        case REC_NEXT_EID: {
+            int32_t next_eid;
+            if (length != sizeof(next_eid)) return false;
+            memcpy(&next_eid, payload, sizeof(next_eid));
+            store.next_eid = next_eid;
+            return true;
+        }
+        case REC_EVENT: {
+            Event event;
+            if (length != sizeof(event)) return false;
+            memcpy(&event, payload, sizeof(event));
+            Event *slot = log_event_slot(event.eid);
+            if (slot == NULL) return false;
+            *slot = event;
+            return true;
+        }
+        case REC_RESERVATION: {
+            LogReservationRecord record;
+            if (length != sizeof(record)) return false;
+            memcpy(&record, payload, sizeof(record));
+            int uid = atoi(record.reservation.uid);
+            LogUser *user = log_user_find_or_insert(uid);
+            if (user == NULL || !ring_push(user, &record.reservation)) return false;
+
+            Event *event = log_event_find(record.reservation.eid);
+            if (event != NULL && record.reserved_seats >= 0) {
+                event->reserved_seats = record.reserved_seats;
+                if (event->state == ACTIVE || event->state == SOLD_OUT) {
+                    event->state = event->reserved_seats >= event->total_seats ? SOLD_OUT : ACTIVE;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * Escreve um registo no fim do segmento atual e aplica-o ao estado em memória (com o lock adquirido).
+ * O registo fica em disco no fsync seguinte da thread do log.
+ */
+static bool log_append(uint32_t type, const void *payload, uint32_t length) {
+    unsigned char buffer[sizeof(LogRecordHeader) + LOG_MAX_PAYLOAD];
+    LogRecordHeader header = { length, record_checksum(type, payload, length), type };
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), payload, length);
+
+    size_t total = sizeof(header) + length;
+    size_t done = 0;
+    while (done < total) {
+        ssize_t w = write(store.fd, buffer + done, total - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("Erro ao escrever no log");
+            // um registo incompleto seria descartado na recuperação, mas os seguintes também:
+            // o segmento volta ao tamanho anterior
+            if (done > 0 && ftruncate(store.fd, store.segment_bytes) != 0) {
+                perror("Erro ao descartar registo incompleto do log");
+            }
+            return false;
+        }
+        done += w;
+    }
+
+    // o primeiro registo por sincronizar acorda a thread do log, que espera o intervalo e faz o fsync
+    if (store.written == store.synced) {
+        pthread_cond_signal(&store.wakeup);
+    }
+    store.written += total;
+    store.segment_bytes += total;
+    STATS_ADD(store.stats, store_records, 1);
+    STATS_ADD(store.stats, store_bytes, total);
+    if (store.segment_bytes >= LOG_SEGMENT_MAX && !store.snapshot_requested) {
+        store.snapshot_requested = true;
+        pthread_cond_signal(&store.wakeup);
+    }
+    return apply_record(type, payload, length);
+}
+
+/**
+ * Lê e aplica os registos de um ficheiro do log. Um registo incompleto ou corrompido termina
+ * a leitura: valid_bytes fica com o tamanho da parte válida do ficheiro.
+ */
+static int replay_file(const char *path, off_t *valid_bytes, bool *complete) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+
+    unsigned char payload[LOG_MAX_PAYLOAD];
+    LogRecordHeader header;
+    int records = 0;
+    *valid_bytes = 0;
+    *complete = false;
+    while (1) {
+        size_t n = fread(&header, 1, sizeof(header), f);
+        if (n == 0 && feof(f)) {
+            *complete = true;
+            break;
+        }
+        if (n != sizeof(header) || header.length > LOG_MAX_PAYLOAD) break;
+        if (fread(payload, 1, header.length, f) != header.length) break;
+        if (record_checksum(header.type, payload, header.length) != header.checksum) break;
+        if (!apply_record(header.type, payload, header.length)) break;
+        *valid_bytes += sizeof(header) + header.length;
+        records++;
+    }
+    fclose(f);
+    return records;
+}
+
+static int compare_segments(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Lista os números dos segmentos existentes em STORE/, por ordem crescente
+ */
+static int list_segments(unsigned **segments_out) {
+    DIR *dir = opendir(STORE_DIR);
+    if (dir == NULL) return -1;
+
+    unsigned *segments = NULL;
+    int count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned number;
+        char extra;
+        if (sscanf(entry->d_name, "log-%u%c", &number, &extra) != 1) continue;
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 16;
+            unsigned *new_segments = realloc(segments, capacity * sizeof(unsigned));
+            if (new_segments == NULL) break;
+            segments = new_segments;
+        }
+        segments[count++] = number;
+    }
+    closedir(dir);
+
+    qsort(segments, count, sizeof(unsigned), compare_segments);
+    *segments_out = segments;
+    return count;
+}
+
+/**
+ * Garante que as entradas criadas ou renomeadas em STORE/ ficam em disco
+ */
+static void sync_store_dir(void) {
+    int dir_fd = open(STORE_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+/**
+ * Abre um segmento novo para as escritas seguintes (com o lock adquirido, ou ainda no arranque)
+ */
+static bool open_segment(unsigned number) {
+    char path[64];
+    snprintf(path, sizeof(path), SEGMENT_PATH_FORMAT, number);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("Erro ao criar segmento do log");
+        return false;
+    }
+    sync_store_dir();
+    store.fd = fd;
+    store.segment = number;
+    store.segment_bytes = 0;
+    return true;
+}
+
+/**
+ * Apaga os segmentos anteriores a first (já incluídos no snapshot)
+ */
+static void remove_segments_before(unsigned first) {
+    unsigned *segments;
+    int count = list_segments(&segments);
+    for (int i = 0; i < count && segments[i] < first; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), SEGMENT_PATH_FORMAT, segments[i]);
+        unlink(path);
+    }
+    if (count >= 0) free(segments);
+}
+
+/**
+ * Escreve um registo num snapshot (sem o aplicar)
+ */
+static bool snapshot_write(FILE *f, uint32_t type, const void *payload, uint32_t length) {
+    LogRecordHeader header = { length, record_checksum(type, payload, length), type };
+    return fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(payload, length, 1, f) == 1;
+}
+
+/**
+ * Escreve o estado completo num snapshot novo e passa a escrever num segmento novo; depois de o snapshot
+ * estar em disco, os segmentos anteriores são apagados (compactação). Chamado pela thread do log.
+ */
+static void log_snapshot(void) {
+    pthread_mutex_lock(&store.lock);
+    store.snapshot_requested = false;
+    // nada foi escrito desde o último snapshot (nem ficaram segmentos do arranque por incluir)
+    if (store.first_segment == store.segment && store.segment_bytes == 0) {
+        pthread_mutex_unlock(&store.lock);
+        return;
+    }
+
+    FILE *f = fopen(SNAPSHOT_TMP_PATH, "w");
+    if (f == NULL) {
+        perror("Erro ao criar snapshot do log");
+        pthread_mutex_unlock(&store.lock);
+        return;
+    }
+
+    // o snapshot inclui tudo o que foi escrito até ao segmento atual
+    uint32_t covered = store.segment + 1;
+    int32_t next_eid = store.next_eid;
+    bool ok = snapshot_write(f, REC_SNAPSHOT, &covered, sizeof(covered)) &&
+              snapshot_write(f, REC_NEXT_EID, &next_eid, sizeof(next_eid));
+    for (size_t i = 0; ok && i < store.user_capacity; i++) {
+        if (store.users[i].record.uid == -1) continue;
+        ok = snapshot_write(f, REC_USER, &store.users[i].record, sizeof(LogUserRecord));
+    }
+    for (int eid = 1; ok && eid < store.event_capacity; eid++) {
+        if (store.events[eid].eid != eid) continue;
+        ok = snapshot_write(f, REC_EVENT, &store.events[eid], sizeof(Event));
+    }
+    for (size_t i = 0; ok && i < store.user_capacity; i++) {
+        ReservationRing *ring = store.users[i].ring;
+        if (store.users[i].record.uid == -1 || ring == NULL) continue;
+        for (int j = 0; ok && j < ring->len; j++) {
+            LogReservationRecord record = { ring->items[(ring->head + j) % RESERVATION_RING_SIZE], -1 };
+            ok = snapshot_write(f, REC_RESERVATION, &record, sizeof(record));
+        }
+    }
+
+    // as escritas seguintes já vão para um segmento que o snapshot não inclui
+    if (ok) {
+        while (store.syncing) {
+            pthread_cond_wait(&store.sync_done, &store.lock);
+        }
+        int old_fd = store.fd;
+        if (open_segment(covered)) {
+            fdatasync(old_fd);
+            close(old_fd);
+            store.synced = store.written;
+        } else {
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&store.lock);
+
+    // o snapshot só substitui o anterior depois de estar todo em disco
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) ok = false;
+    if (fclose(f) != 0) ok = false;
+    if (!ok || rename(SNAPSHOT_TMP_PATH, SNAPSHOT_PATH) != 0) {
+        perror("Erro ao escrever snapshot do log");
+        unlink(SNAPSHOT_TMP_PATH);
+        return;
+    }
+    sync_store_dir();
+
+    store.first_segment = covered;
+    remove_segments_before(covered);
+    STATS_ADD(store.stats, store_snapshots, 1);
+    if (store.verbose) printf("VERBOSE STORAGE: Snapshot written; log segments before %u removed.\n", covered);
+}
+
+/**
+ * Thread do log: faz o fsync em grupo dos registos escritos em cada intervalo e os snapshots periódicos
+ */
+static void *log_thread(void *arg) {
+    (void)arg;
+    time_t last_snapshot = time(NULL);
+
+    pthread_mutex_lock(&store.lock);
+    while (store.running) {
+        // com registos por sincronizar, espera o intervalo do fsync em grupo; senão, até ao próximo snapshot
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        if (store.written > store.synced) {
+            deadline.tv_nsec += LOG_SYNC_INTERVAL_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+        } else {
+            deadline.tv_sec += LOG_SNAPSHOT_INTERVAL - (time(NULL) - last_snapshot);
+        }
+        bool timed_out = pthread_cond_timedwait(&store.wakeup, &store.lock, &deadline) == ETIMEDOUT;
+
+        // um único fsync para tudo o que foi escrito durante o intervalo
+        if (timed_out && store.written > store.synced) {
+            uint64_t target = store.written;
+            int fd = store.fd;
+            store.syncing = true;
+            pthread_mutex_unlock(&store.lock);
+            if (fdatasync(fd) != 0) perror("Erro no fsync do log");
+            STATS_ADD(store.stats, store_syncs, 1);
+            pthread_mutex_lock(&store.lock);
+            store.syncing = false;
+            if (target > store.synced) store.synced = target;
+            pthread_cond_broadcast(&store.sync_done);
+        }
+
+        time_t now = time(NULL);
+        if (store.running && (store.snapshot_requested || now - last_snapshot >= LOG_SNAPSHOT_INTERVAL)) {
+            pthread_mutex_unlock(&store.lock);
+            log_snapshot();
+            last_snapshot = now;
+            pthread_mutex_lock(&store.lock);
+        }
+    }
+    pthread_mutex_unlock(&store.lock);
+    return NULL;
+}
+
+/**
+ * Recupera o estado a partir do snapshot e dos segmentos seguintes e abre um segmento novo
+ */
+static bool log_open(ServerStats *stats, bool verbose) {
+    store.stats = stats;
+    store.verbose = verbose;
+    mkdir(STORE_DIR, 0700);
+    mkdir(DESCRIPTIONS_DIR, 0700);
+
+    off_t valid_bytes;
+    bool complete;
+    store.first_segment = 1;
+    int records = replay_file(SNAPSHOT_PATH, &valid_bytes, &complete);
+    if (records >= 0 && !complete) {
+        // o snapshot é escrito num ficheiro temporário e só depois renomeado: não pode estar incompleto
+        fprintf(stderr, "Snapshot %s corrompido.\n", SNAPSHOT_PATH);
+        return false;
+    }
+    if (records < 0) records = 0;
+
+    unsigned *segments;
+    int count = list_segments(&segments);
+    if (count < 0) return false;
+
+    unsigned last = store.first_segment - 1;
+    int replayed = 0;
+    for (int i = 0; i < count; i++) {
+        if (segments[i] < store.first_segment) continue;
+        char path[64];
+        snprintf(path, sizeof(path), SEGMENT_PATH_FORMAT, segments[i]);
+        int n = replay_file(path, &valid_bytes, &complete);
+        if (n < 0) continue;
+        records += n;
+        replayed++;
+        last = segments[i];
+
+        // o fim do segmento foi interrompido a meio de uma escrita: descarta-se a parte inválida
+        if (!complete) {
+            fprintf(stderr, "Registo incompleto no fim de %s: descartado.\n", path);
+            if (truncate(path, valid_bytes) != 0) perror("Erro ao truncar segmento do log");
+        }
+    }
+    free(segments);
+
+    // segmentos já incluídos no snapshot (compactação interrompida) são apagados
+    remove_segments_before(store.first_segment);
+
+    if (!open_segment(last + 1)) return false;
+    if (verbose) printf("VERBOSE STORAGE: Log recovered: %d records from snapshot and %d segments.\n", records, replayed);
+
+    store.running = true;
+    if (pthread_create(&store.thread, NULL, log_thread, NULL) != 0) {
+        perror("Erro ao criar thread do log");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Pára a thread do log e garante que todos os registos ficam em disco
+ */
+static void log_close(void) {
+    pthread_mutex_lock(&store.lock);
+    bool running = store.running;
+    store.running = false;
+    pthread_cond_signal(&store.wakeup);
+    pthread_mutex_unlock(&store.lock);
+    if (!running) return;
+
+    pthread_join(store.thread, NULL);
+    fdatasync(store.fd);
+    close(store.fd);
+    store.fd = -1;
+}
+
+static int log_load_users(UserLoader loader) {
+    pthread_mutex_lock(&store.lock);
+    int loaded = 0;
+    for (size_t i = 0; i < store.user_capacity; i++) {
+        LogUserRecord *record = &store.users[i].record;
+        if (record->uid == -1) continue;
+        char uid[7];
+        snprintf(uid, sizeof(uid), "%06d", record->uid);
+        loader(uid, record->registered, record->logged_in, record->password);
+        loaded++;
+    }
+    pthread_mutex_unlock(&store.lock);
+    return loaded;
+}
+
+static int log_load_events(EventLoader loader) {
+    pthread_mutex_lock(&store.lock);
+    int loaded = 0;
+    for (int eid = 1; eid < store.event_capacity; eid++) {
+        if (store.events[eid].eid != eid) continue;
+        if (!loader(&store.events[eid])) break;
+        loaded++;
+    }
+    pthread_mutex_unlock(&store.lock);
+    return loaded;
+}
+
+static int log_load_next_eid(void) {
+    pthread_mutex_lock(&store.lock);
+    int next_eid = store.next_eid;
+    pthread_mutex_unlock(&store.lock);
+    return next_eid;
+}
+
+/**
+ * Escreve o novo estado completo de um utilizador (com o lock adquirido)
+ */
+static bool log_put_user(const LogUserRecord *record) {
+    return log_append(REC_USER, record, sizeof(*record));
+}
+
+static bool log_create_user(const char *uid, const char *password) {
+    pthread_mutex_lock(&store.lock);
+    LogUser *user = log_user_find(atoi(uid));
+    LogUserRecord record;
+    if (user != NULL) {
+        record = user->record;
+    } else {
+        memset(&record, 0, sizeof(record));
+        record.uid = atoi(uid);
+    }
+    record.registered = true;
+    snprintf(record.password, sizeof(record.password), "%s", password);
+    bool ok = log_put_user(&record);
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_set_login(const char *uid, bool logged_in) {
+    pthread_mutex_lock(&store.lock);
+    LogUser *user = log_user_find(atoi(uid));
+    bool ok = user != NULL;
+    if (ok && user->record.logged_in != logged_in) {
+        LogUserRecord record = user->record;
+        record.logged_in = logged_in;
+        ok = log_put_user(&record);
+    }
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_set_password(const char *uid, const char *password) {
+    pthread_mutex_lock(&store.lock);
+    LogUser *user = log_user_find(atoi(uid));
+    bool ok = user != NULL;
+    if (ok) {
+        LogUserRecord record = user->record;
+        snprintf(record.password, sizeof(record.password), "%s", password);
+        ok = log_put_user(&record);
+    }
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_remove_user(const char *uid) {
+    pthread_mutex_lock(&store.lock);
+    LogUser *user = log_user_find(atoi(uid));
+    bool ok = user != NULL;
+    if (ok) {
+        LogUserRecord record = user->record;
+        record.registered = false;
+        record.logged_in = false;
+        memset(record.password, 0, sizeof(record.password));
+        ok = log_put_user(&record);
+    }
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_save_next_eid(int next_eid) {
+    int32_t value = next_eid;
+    pthread_mutex_lock(&store.lock);
+    bool ok = log_append(REC_NEXT_EID, &value, sizeof(value));
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_create_event(const Event *event) {
+    pthread_mutex_lock(&store.lock);
+    bool ok = log_append(REC_EVENT, event, sizeof(*event));
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_add_reservation(const Reservation *reservation, int reserved_seats) {
+    LogReservationRecord record = { *reservation, reserved_seats };
+    pthread_mutex_lock(&store.lock);
+    bool ok = log_append(REC_RESERVATION, &record, sizeof(record));
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+static bool log_end_event(int eid, EventState state) {
+    pthread_mutex_lock(&store.lock);
+    Event *event = log_event_find(eid);
+    bool ok = event != NULL;
+    if (ok) {
+        Event ended = *event;
+        ended.state = state;
+        ok = log_append(REC_EVENT, &ended, sizeof(ended));
+    }
+    pthread_mutex_unlock(&store.lock);
+    return ok;
+}
+
+/**
+ * Percorre as reservas guardadas no anel do utilizador, da mais recente para a mais antiga
+ */
+static int log_list_reservations(const char *uid, ReservationVisitor visit, void *ctx) {
+    Reservation items[RESERVATION_RING_SIZE];
+    int count = 0;
+
+    pthread_mutex_lock(&store.lock);
+    LogUser *user = log_user_find(atoi(uid));
+    if (user != NULL && user->ring != NULL) {
+        ReservationRing *ring = user->ring;
+        for (int i = ring->len - 1; i >= 0; i--) {
+            items[count++] = ring->items[(ring->head + i) % RESERVATION_RING_SIZE];
+        }
+    }
+    pthread_mutex_unlock(&store.lock);
+
+    // o visitante é chamado fora do lock
+    int visited = 0;
+    while (visited < count) {
+        if (!visit(&items[visited++], ctx)) break;
+    }
+    return visited;
+}
+
+/**
+ * Os ficheiros de descrição ficam todos em STORE/DESCRIPTIONS/, sem diretorias por evento
+ */
+static void log_description_path(int eid, const char *filename, char *path, size_t size) {
+    snprintf(path, size, DESCRIPTIONS_DIR "/%03d-%s", eid, filename);
+}
+
+static bool log_prepare_description(int eid, const char *filename, char *path, size_t size) {
+    log_description_path(eid, filename, path, size);
+    return true;
+}
+
+static void log_discard_description(int eid, const char *filename) {
+    char path[256];
+    log_description_path(eid, filename, path, sizeof(path));
+    unlink(path);
+}
+
+const StorageEngine log_storage = {
+    .name = "log",
+    .open = log_open,
+    .close = log_close,
+    .load_users = log_load_users,
+    .load_events = log_load_events,
+    .load_next_eid = log_load_next_eid,
+    .create_user = log_create_user,
+    .set_login = log_set_login,
+    .set_password = log_set_password,
+    .remove_user = log_remove_user,
+    .save_next_eid = log_save_next_eid,
+    .create_event = log_create_event,
+    .add_reservation = log_add_reservation,
+    .end_event = log_end_event,
+    .list_reservations = log_list_reservations,
+    .prepare_description = log_prepare_description,
+    .discard_description = log_discard_description,
+    .description_path = log_description_path,
+};
@@ -2,6 +2,10 @@
 #define STRUCTURES_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+#include "stats.h"
 
 /*
  * Enum para representar os diferentes estados de um evento.
@@ -29,11 +33,13 @@ typedef struct User {
 
 /*
  * Estrutura para armazenar a informação de um evento.
+ * É a cópia em memória de START_<eid>.txt, RES_<eid>.txt e END_<eid>.txt.
  */
 typedef struct Event {
     int eid;
     char name[11];
-    char date[17];
+    char date[17];          // dd-mm-yyyy hh:mm
+    time_t event_time;      // date convertida uma única vez, na criação ou no arranque
     int total_seats;
     int reserved_seats;
     char owner_uid[7];
@@ -42,12 +48,32 @@ typedef struct Event {
 } Event;
 
 
+/*
+ * Estrutura para armazenar uma reserva (o conteúdo de um ficheiro R-<uid>-<data>.txt).
+ */
+typedef struct Reservation {
+    int eid;
+    char uid[7];
+    int seats;
+    char datetime[20];      // dd-mm-yyyy HH:MM:SS
+} Reservation;
+
+
 /*
  * Estrutura principal do servidor para gerir todo o estado.
  * Agrupa as listas de users e eventos num só local.
+ * É partilhada por todos os workers, pelo que o acesso é protegido por mutexes.
  */
 typedef struct ServerState {
     int next_eid;
+    pthread_mutex_t eid_lock;          // protege next_eid e o seu registo (EVENTS/eid.dat nos ficheiros)
+    pthread_mutex_t reservation_lock;  // protege os contadores RES_<eid>.txt e o fecho de eventos
+    pthread_mutex_t users_lock;        // protege o registo e a remoção de utilizadores
+    int keepalive_max_requests;        // pedidos por conexão TCP persistente (KAL); 0 desativa
+    int idle_timeout;                  // segundos até fechar uma conexão TCP inativa; 0 desativa
+    size_t list_response_max;          // tamanho máximo de uma resposta LST (bytes); 0 = sem limite
+    size_t udp_response_max;           // tamanho máximo de uma resposta UDP (LME/LMR), até UDP_RESPONSE_MAX
+    ServerStats stats;
 } ServerState;
 
 /*
@@ -60,6 +86,8 @@ typedef struct ClientState {
     char *server_ip;
     int server_port;
     struct hostent *host_info;
+    bool keep_alive;    // reutilizar a conexão TCP entre comandos (KAL)
+    int tcp_fd;         // conexão TCP persistente (-1 se não existir)
 } ClientState;
 
 
@@ -0,0 +1,530 @@
+#define _GNU_SOURCE
+
+#include "uring_backend.h"
+#include "io_ring.h"
+#include "connection.h"
+#include "server_logic.h"
+#include "data_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Número de entradas do anel de submissão de cada worker
+#define URING_ENTRIES 4096
+
+// Número de pedidos UDP que cada worker mantém em curso em simultâneo
+#define URING_UDP_SLOTS 32
+
+// Etiquetas guardadas nos bits menos significativos do user_data de cada SQE
+#define TAG_CONN 0UL
+#define TAG_UDP 1UL
+#define TAG_MASK 3UL
+
+// Valores fixos de user_data para operações sem estado associado
+#define USER_DATA_ACCEPT 2UL
+#define USER_DATA_IGNORE 3UL
+#define USER_DATA_IDLE_TIMER 4UL
+
+// Intervalo (s) entre verificações de conexões inativas
+#define URING_IDLE_SWEEP_INTERVAL 1
+
+/*
+ * Operação io_uring em curso numa conexão TCP (no máximo uma de cada vez).
+ */
+typedef enum {
+    UOP_NONE,
+    UOP_RECV_REQUEST,
+    UOP_RECV_BODY,
+    UOP_WRITE_BODY,
+    UOP_SEND,
+    UOP_READ_FILE
+} UringOp;
+
+/*
+ * Pedido UDP em curso: a mesma entrada recebe o datagrama e envia a resposta.
+ */
+typedef struct UdpSlot {
+    bool sending;
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in addr;
+    char buffer[1024];
+    char response[UDP_RESPONSE_MAX];
+} UdpSlot;
+
+/*
+ * Estado de um worker que usa o backend io_uring.
+ */
+typedef struct UringWorker {
+    IoRing ring;
+    int id;
+    int udp_fd;
+    int tcp_fd;
+    ConnTable connections;
+    ServerState *server_data;
+    bool verbose;
+    struct sockaddr_in accept_addr;
+    socklen_t accept_len;
+    UdpSlot *udp_slots;
+    struct __kernel_timespec idle_sweep;
+} UringWorker;
+
+
+/**
+ * Verifica se é possível criar um io_uring neste kernel
+ */
+bool uring_backend_available(void) {
+    IoRing ring;
+    if (io_ring_init(&ring, 8) < 0) return false;
+    io_ring_destroy(&ring);
+    return true;
+}
+
+/**
+ * Coloca um descritor em modo bloqueante: as operações do io_uring esperam pelo socket
+ * dentro do kernel, em vez de devolverem EAGAIN
+ */
+static void clear_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags != -1) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+}
+
+static struct io_uring_sqe *uring_get_sqe(UringWorker *w) {
+    struct io_uring_sqe *sqe = io_ring_get_sqe(&w->ring);
+    if (sqe == NULL) {
+        handle_error("Erro ao submeter pedidos ao io_uring");
+    }
+    return sqe;
+}
+
+/**
+ * Submete um accept para a próxima conexão TCP
+ */
+static void uring_arm_accept(UringWorker *w) {
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    w->accept_len = sizeof(w->accept_addr);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = w->tcp_fd;
+    sqe->addr = (uintptr_t)&w->accept_addr;
+    sqe->addr2 = (uintptr_t)&w->accept_len;
+    sqe->user_data = USER_DATA_ACCEPT;
+}
+
+/**
+ * Submete o temporizador que acorda o worker para fechar as conexões inativas
+ */
+static void uring_arm_idle_timer(UringWorker *w) {
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    w->idle_sweep.tv_sec = URING_IDLE_SWEEP_INTERVAL;
+    w->idle_sweep.tv_nsec = 0;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)&w->idle_sweep;
+    sqe->len = 1;
+    sqe->user_data = USER_DATA_IDLE_TIMER;
+}
+
+/**
+ * Termina as conexões inativas. Cada uma tem uma operação em curso que ainda referencia
+ * a conexão, por isso o socket é apenas desligado: a operação termina com erro ou EOF
+ * e a conexão é fechada quando a sua conclusão chegar.
+ */
+static void uring_expire_idle(UringWorker *w) {
+    int idle_timeout = w->server_data->idle_timeout;
+    Connection *conn;
+    while ((conn = conn_table_next_expired(&w->connections, idle_timeout)) != NULL) {
+        if (w->verbose) {
+            printf("VERBOSE SERVER.C: TCP client (fd: %d) idle for %ds, closing connection.\n", conn->fd, idle_timeout);
+        }
+        conn_table_untrack(&w->connections, conn);
+        conn->idle_expired = true;
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    uring_arm_idle_timer(w);
+}
+
+/**
+ * Submete a receção de um datagrama UDP para a entrada indicada
+ */
+static void uring_arm_udp_recv(UringWorker *w, UdpSlot *slot) {
+    slot->sending = false;
+    slot->iov.iov_base = slot->buffer;
+    slot->iov.iov_len = sizeof(slot->buffer) - 1;
+    memset(&slot->msg, 0, sizeof(slot->msg));
+    slot->msg.msg_name = &slot->addr;
+    slot->msg.msg_namelen = sizeof(slot->addr);
+    slot->msg.msg_iov = &slot->iov;
+    slot->msg.msg_iovlen = 1;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = w->udp_fd;
+    sqe->addr = (uintptr_t)&slot->msg;
+    sqe->len = 1;
+    sqe->user_data = (uintptr_t)slot | TAG_UDP;
+}
+
+/**
+ * Trata a conclusão de uma operação UDP: processa o pedido recebido e submete a resposta,
+ * ou, depois de enviada a resposta, volta a receber
+ */
+static void uring_udp_complete(UringWorker *w, UdpSlot *slot, int res) {
+    if (slot->sending) {
+        if (res < 0) {
+            fprintf(stderr, "Erro ao enviar resposta UDP: %s\n", strerror(-res));
+        } else if (w->verbose) {
+            printf("VERBOSE: UDP response sent to %s:%d: %s", inet_ntoa(slot->addr.sin_addr), ntohs(slot->addr.sin_port), slot->response);
+        }
+        uring_arm_udp_recv(w, slot);
+        return;
+    }
+
+    if (res <= 0) {
+        if (res < 0 && res != -EINTR && res != -EAGAIN) {
+            fprintf(stderr, "Erro no recvmsg UDP: %s\n", strerror(-res));
+        }
+        uring_arm_udp_recv(w, slot);
+        return;
+    }
+
+    slot->buffer[res] = '\0';
+    size_t response_len = process_udp_request(&slot->addr, slot->buffer, slot->response, sizeof(slot->response), w->server_data, w->verbose);
+
+    slot->sending = true;
+    slot->iov.iov_base = slot->response;
+    slot->iov.iov_len = response_len;
+    slot->msg.msg_namelen = sizeof(slot->addr);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = w->udp_fd;
+    sqe->addr = (uintptr_t)&slot->msg;
+    sqe->len = 1;
+    sqe->user_data = (uintptr_t)slot | TAG_UDP;
+}
+
+/**
+ * Submete uma operação de leitura/escrita associada a uma conexão
+ */
+static struct io_uring_sqe *uring_conn_submit(UringWorker *w, Connection *conn, UringOp op, int opcode, int fd, void *buf, size_t len, off_t offset) {
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = (uintptr_t)conn | TAG_CONN;
+    conn->uring_op = op;
+    return sqe;
+}
+
+/**
+ * Fecha uma conexão: o shutdown e o close são submetidos ao io_uring, ligados entre si
+ */
+static void uring_conn_close(UringWorker *w, Connection *conn) {
+    int fd = conn->fd;
+    conn_table_remove(&w->connections, fd);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(w);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = fd;
+    sqe->len = SHUT_WR;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = USER_DATA_IGNORE;
+
+    sqe = uring_get_sqe(w);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = USER_DATA_IGNORE;
+}
+
+/**
+ * Submete o envio do que estiver na fila de saída da conexão
+ */
+static struct io_uring_sqe *uring_conn_send(UringWorker *w, Connection *conn) {
+    return uring_conn_submit(w, conn, UOP_SEND, IORING_OP_SEND, conn->fd,
+                             conn->out.data + conn->out.off, out_queue_pending(&conn->out), 0);
+}
+
+/**
+ * Avança a máquina de estados de uma conexão até submeter a próxima operação
+ * (ou até a conexão terminar)
+ */
+static void uring_conn_advance(UringWorker *w, Connection *conn) {
+    while (1) {
+        switch (conn->phase) {
+            case CONN_READ_REQUEST:
+                // contrapressão: enquanto a fila de saída estiver cheia, só se envia
+                if (conn_output_throttled(conn, w->server_data, w->verbose)) {
+                    uring_conn_send(w, conn);
+                    return;
+                }
+                if (conn_request_ready(conn)) {
+                    conn_dispatch_request(conn, w->server_data, w->verbose);
+                    continue;
+                }
+                // sem pedidos completos: enviar primeiro as respostas acumuladas
+                if (out_queue_pending(&conn->out) > 0) {
+                    uring_conn_send(w, conn);
+                    return;
+                }
+                uring_conn_submit(w, conn, UOP_RECV_REQUEST, IORING_OP_RECV, conn->fd,
+                                  conn->in_buf + conn->in_len, CONN_REQUEST_MAX - conn->in_len, 0);
+                return;
+
+            case CONN_READ_BODY:
+                // as respostas aos pedidos anteriores seguem antes de se receber o ficheiro
+                if (out_queue_pending(&conn->out) > 0) {
+                    uring_conn_send(w, conn);
+                    return;
+                }
+
+                // CRE recusado: o bloco recebido é descartado
+                if (conn->body_discard) conn->chunk_off = conn->chunk_len;
+
+                // escrever em disco o bloco recebido antes de pedir o seguinte
+                if (conn->chunk_off < conn->chunk_len) {
+                    uring_conn_submit(w, conn, UOP_WRITE_BODY, IORING_OP_WRITE, conn->body_fd,
+                                      conn->body_chunk + conn->chunk_off, conn->chunk_len - conn->chunk_off, conn->body_offset);
+                    return;
+                }
+                if (conn->body_remaining == 0) {
+                    conn_finish_body(conn, w->server_data, true, w->verbose);
+                    continue;
+                }
+                if (conn->body_chunk == NULL) {
+                    conn->body_chunk = malloc(CONN_BODY_CHUNK);
+                    if (conn->body_chunk == NULL) {
+                        conn_finish_body(conn, w->server_data, false, w->verbose);
+                        continue;
+                    }
+                }
+                uring_conn_submit(w, conn, UOP_RECV_BODY, IORING_OP_RECV, conn->fd, conn->body_chunk,
+                                  conn->body_remaining < CONN_BODY_CHUNK ? (size_t)conn->body_remaining : CONN_BODY_CHUNK, 0);
+                return;
+
+            case CONN_SEND_FILE:
+                if (out_queue_pending(&conn->out) > 0) {
+                    // o cabeçalho e os blocos de um SED seguem com MSG_MORE; o '\n' final envia o que restar
+                    struct io_uring_sqe *sqe = uring_conn_send(w, conn);
+                    sqe->msg_flags = MSG_MORE;
+                    return;
+                }
+                if (conn->file_remaining > 0) {
+                    size_t to_read = conn->file_remaining < CONN_BODY_CHUNK ? (size_t)conn->file_remaining : CONN_BODY_CHUNK;
+                    char *dst = out_queue_reserve(&conn->out, to_read);
+                    if (dst == NULL) {
+                        uring_conn_close(w, conn);
+                        return;
+                    }
+                    uring_conn_submit(w, conn, UOP_READ_FILE, IORING_OP_READ, conn->file_fd, dst, to_read, conn->file_offset);
+                    return;
+                }
+                conn_file_sent(conn, w->server_data, w->verbose);
+                continue;
+
+            case CONN_WRITE_RESPONSE:
+                if (out_queue_pending(&conn->out) > 0) {
+                    uring_conn_send(w, conn);
+                    return;
+                }
+                conn->phase = CONN_DONE;
+                continue;
+
+            case CONN_DONE:
+            default:
+                uring_conn_close(w, conn);
+                return;
+        }
+    }
+}
+
+/**
+ * Trata a conclusão da operação em curso numa conexão TCP
+ */
+static void uring_conn_complete(UringWorker *w, Connection *conn, int res) {
+    UringOp op = conn->uring_op;
+    conn->uring_op = UOP_NONE;
+
+    // a conexão excedeu o tempo de inatividade e já não tem operações em curso
+    if (conn->idle_expired) {
+        uring_conn_close(w, conn);
+        return;
+    }
+    conn_table_touch(&w->connections, conn);
+
+    // operação interrompida: a mesma operação volta a ser submetida
+    if (res == -EINTR || res == -EAGAIN) {
+        uring_conn_advance(w, conn);
+        return;
+    }
+
+    switch (op) {
+        case UOP_RECV_REQUEST:
+            if (res < 0) {
+                fprintf(stderr, "Erro ao ler do socket TCP do cliente: %s\n", strerror(-res));
+                uring_conn_close(w, conn);
+                return;
+            }
+            if (res == 0) {
+                if (conn->in_len == 0) {
+                    if (w->verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected.\n", conn->fd);
+                    // enviar as respostas que ainda estão em fila antes de fechar
+                    conn->keep_alive = false;
+                    conn->phase = CONN_WRITE_RESPONSE;
+                    break;
+                }
+                // o cliente terminou o envio sem completar o cabeçalho: processar o que foi recebido
+                conn->keep_alive = false;
+                conn_dispatch_request(conn, w->server_data, w->verbose);
+                break;
+            }
+            conn->in_len += res;
+            conn->in_buf[conn->in_len] = '\0';
+            break;
+
+        case UOP_RECV_BODY:
+            if (res <= 0) {
+                if (w->verbose) printf("VERBOSE SERVER.C: TCP client (fd: %d) disconnected during upload.\n", conn->fd);
+                uring_conn_close(w, conn);
+                return;
+            }
+            conn->chunk_len = res;
+            conn->chunk_off = 0;
+            conn->body_remaining -= res;
+            break;
+
+        case UOP_WRITE_BODY:
+            if (res < 0) {
+                fprintf(stderr, "Erro ao escrever ficheiro do evento no servidor: %s\n", strerror(-res));
+                conn->chunk_len = conn->chunk_off = 0;
+                conn_finish_body(conn, w->server_data, false, w->verbose);
+                break;
+            }
+            STATS_ADD(&w->server_data->stats, cre_copy_bytes, res);
+            conn->chunk_off += res;
+            conn->body_offset += res;
+            break;
+
+        case UOP_SEND:
+            if (res < 0) {
+                fprintf(stderr, "Erro ao escrever no socket TCP do cliente: %s\n", strerror(-res));
+                uring_conn_close(w, conn);
+                return;
+            }
+            out_queue_consume(&conn->out, res);
+            break;
+
+        case UOP_READ_FILE:
+            if (res <= 0) {
+                fprintf(stderr, "Erro ao ler ficheiro de descrição: %s\n", res < 0 ? strerror(-res) : "fim de ficheiro inesperado");
+                uring_conn_close(w, conn);
+                return;
+            }
+            STATS_ADD(&w->server_data->stats, sed_copy_bytes, res);
+            out_queue_commit(&conn->out, res);
+            conn->file_offset += res;
+            conn->file_remaining -= res;
+            break;
+
+        case UOP_NONE:
+        default:
+            break;
+    }
+
+    uring_conn_advance(w, conn);
+}
+
+/**
+ * Trata a conclusão de um accept: regista a nova conexão e volta a aceitar
+ */
+static void uring_accept_complete(UringWorker *w, int res) {
+    if (res >= 0) {
+        Connection *conn = conn_table_add(&w->connections, res, &w->accept_addr);
+        if (conn == NULL) {
+            fprintf(stderr, "Out of memory for TCP connection table. Connection rejected (fd: %d).\n", res);
+            close(res);
+        } else {
+            if (w->verbose) {
+                printf("VERBOSE SERVER.C: New TCP connection accepted from %s:%d (fd: %d, active: %d).\n",
+                       inet_ntoa(w->accept_addr.sin_addr), ntohs(w->accept_addr.sin_port), res, w->connections.count);
+            }
+            uring_conn_advance(w, conn);
+        }
+    } else if (res != -EINTR && res != -EAGAIN && res != -ECONNABORTED) {
+        fprintf(stderr, "Erro no accept: %s\n", strerror(-res));
+    }
+    uring_arm_accept(w);
+}
+
+/**
+ * Loop de eventos de um worker com io_uring: todas as operações de rede e de ficheiros
+ * de descrição submetidas durante uma iteração são enviadas ao kernel numa só chamada
+ * io_uring_enter, que também espera pelas conclusões seguintes.
+ */
+void uring_worker_run(int worker_id, int udp_fd, int tcp_fd, ServerState *server_data, bool verbose) {
+    UringWorker w;
+    memset(&w, 0, sizeof(w));
+    w.id = worker_id;
+    w.udp_fd = udp_fd;
+    w.tcp_fd = tcp_fd;
+    w.server_data = server_data;
+    w.verbose = verbose;
+    conn_table_init(&w.connections);
+
+    if (io_ring_init(&w.ring, URING_ENTRIES) < 0) {
+        handle_error("Erro ao criar io_uring");
+    }
+
+    clear_nonblocking(udp_fd);
+    clear_nonblocking(tcp_fd);
+
+    w.udp_slots = calloc(URING_UDP_SLOTS, sizeof(UdpSlot));
+    if (w.udp_slots == NULL) {
+        handle_error("Erro ao alocar pedidos UDP do io_uring");
+    }
+    for (int i = 0; i < URING_UDP_SLOTS; i++) {
+        uring_arm_udp_recv(&w, &w.udp_slots[i]);
+    }
+    uring_arm_accept(&w);
+    if (server_data->idle_timeout > 0) {
+        uring_arm_idle_timer(&w);
+    }
+
+    if (verbose) {
+        printf("VERBOSE SERVER.C: Worker %d started with io_uring backend (udp fd: %d, tcp fd: %d).\n", worker_id, udp_fd, tcp_fd);
+    }
+
+    while (1) {
+        if (io_ring_submit_and_wait(&w.ring, 1) < 0) {
+            handle_error("Erro no io_uring_enter");
+        }
+        stats_print_if_requested(&server_data->stats);
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = io_ring_peek_cqe(&w.ring)) != NULL) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            io_ring_cqe_seen(&w.ring);
+
+            if (user_data == USER_DATA_ACCEPT) {
+                uring_accept_complete(&w, res);
+            } else if (user_data == USER_DATA_IGNORE) {
+                continue;
+            } else if (user_data == USER_DATA_IDLE_TIMER) {
+                uring_expire_idle(&w);
+            } else if ((user_data & TAG_MASK) == TAG_UDP) {
+                uring_udp_complete(&w, (UdpSlot *)(uintptr_t)(user_data & ~TAG_MASK), res);
+            } else {
+                uring_conn_complete(&w, (Connection *)(uintptr_t)user_data, res);
+            }
+        }
+    }
+}
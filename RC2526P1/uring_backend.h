@@ -0,0 +1,13 @@
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include "structures.h"
+#include <stdbool.h>
+
+// Verifica se o kernel suporta io_uring
+bool uring_backend_available(void);
+
+// Loop de eventos de um worker baseado em io_uring (não retorna)
+void uring_worker_run(int worker_id, int udp_fd, int tcp_fd, ServerState *server_data, bool verbose);
+
+#endif
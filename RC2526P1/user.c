@@ -10,6 +10,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <signal.h>
 
 #define GROUP_NUMBER 66
 #define DEFAULT_PORT (58000 + GROUP_NUMBER)
@@ -29,9 +30,10 @@ int main(int argc, char *argv[]) {
     client_state.is_logged_in = false;
     client_state.server_ip = server_ip; // IP padrão
     client_state.server_port = server_port; // IP padrão
+    client_state.tcp_fd = -1;
 
-    // getopt para processar os argumentos -n e -p
-    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+    // getopt para processar os argumentos -n, -p e -k
+    while ((opt = getopt(argc, argv, "n:p:k")) != -1) {
         switch (opt) {
             case 'n':
                 server_ip = optarg;
@@ -39,13 +41,22 @@ int main(int argc, char *argv[]) {
             case 'p':
                 client_state.server_port = atoi(optarg);
                 break;
+            case 'k':
+                // reutilizar a mesma conexão TCP entre comandos
+                client_state.keep_alive = true;
+                break;
             default:
-                fprintf(stderr, "Uso: %s [-n ESIP] [-p ESport]\n", argv[0]);
+                fprintf(stderr, "Uso: %s [-n ESIP] [-p ESport] [-k]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
     client_state.server_ip = server_ip; // IP após parsing
 
+    // a conexão persistente pode ter sido fechada pelo servidor: um write falhado não deve terminar a aplicação
+    if (client_state.keep_alive) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+
     printf("Aplicação de Utilizador a iniciar...\n");
     printf("A ligar ao Servidor de Eventos em %s:%d\n", client_state.server_ip, client_state.server_port);
 
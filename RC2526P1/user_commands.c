@@ -10,6 +10,7 @@
 #include <netdb.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <poll.h>
 #include "utils.h"
 
 void user_handle_error(const char *msg) {
@@ -46,6 +47,105 @@ int create_tcp_socket_and_connect(ClientState *client_state, struct sockaddr_in
     return tcp_fd;
 }
 
+// Verifica se a conexão persistente ainda pode ser usada: não deve haver nada para ler
+// (nem EOF, enviado pelo servidor ao fechá-la por inatividade ou limite de pedidos)
+static bool tcp_connection_is_idle(int tcp_fd) {
+    struct pollfd pfd = { .fd = tcp_fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 0;
+}
+
+// Função auxiliar para obter a conexão TCP de um comando.
+// Com conexões persistentes (-k), a conexão é pedida ao servidor com KAL e reutilizada entre comandos.
+int get_tcp_connection(ClientState *client_state, struct sockaddr_in *server_addr_out) {
+    if (client_state->tcp_fd >= 0) {
+        if (tcp_connection_is_idle(client_state->tcp_fd)) {
+            return client_state->tcp_fd;
+        }
+        close(client_state->tcp_fd);
+        client_state->tcp_fd = -1;
+    }
+
+    int tcp_fd = create_tcp_socket_and_connect(client_state, server_addr_out);
+    if (!client_state->keep_alive) return tcp_fd;
+
+    const char *request = "KAL\n";
+    char response_buffer[64];
+    ssize_t n = -1;
+    if (write(tcp_fd, request, strlen(request)) != -1) {
+        n = read_tcp_response(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
+    }
+    if (n > 0) {
+        response_buffer[n] = '\0';
+        if (strncmp(response_buffer, "RKA OK", 6) == 0) {
+            client_state->tcp_fd = tcp_fd;
+            return tcp_fd;
+        }
+    }
+
+    // o servidor não aceita conexões persistentes: voltar a uma conexão por comando
+    printf("O servidor não aceitou uma conexão persistente. A usar uma conexão por comando.\n");
+    client_state->keep_alive = false;
+    close(tcp_fd);
+    return create_tcp_socket_and_connect(client_state, server_addr_out);
+}
+
+// Liberta a conexão TCP de um comando: a conexão persistente só é mantida se a resposta foi lida por completo
+void release_tcp_connection(ClientState *client_state, int tcp_fd, bool reusable) {
+    if (tcp_fd == client_state->tcp_fd) {
+        if (reusable) return;
+        client_state->tcp_fd = -1;
+    }
+    close(tcp_fd);
+}
+
+// Lê uma resposta TCP terminada em '\n' (ou até o servidor fechar a conexão ou o buffer encher)
+ssize_t read_tcp_response(int tcp_fd, char *buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(tcp_fd, buffer + total, size - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return total > 0 ? (ssize_t)total : -1;
+        }
+        if (n == 0) break;
+        total += n;
+        if (buffer[total - 1] == '\n') break;
+    }
+    return total;
+}
+
+// Lê uma resposta TCP de tamanho arbitrário (por exemplo, a listagem do LST) para um buffer alocado,
+// terminado em '\0', que o chamador tem de libertar
+ssize_t read_tcp_response_alloc(int tcp_fd, char **buffer_out) {
+    size_t cap = 4096, total = 0;
+    char *buffer = malloc(cap);
+    if (buffer == NULL) return -1;
+
+    while (1) {
+        if (total + 1 == cap) {
+            char *new_buffer = realloc(buffer, cap * 2);
+            if (new_buffer == NULL) break;
+            buffer = new_buffer;
+            cap *= 2;
+        }
+        ssize_t n = read(tcp_fd, buffer + total, cap - 1 - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (total == 0) {
+                free(buffer);
+                return -1;
+            }
+            break;
+        }
+        if (n == 0) break;
+        total += n;
+        if (buffer[total - 1] == '\n') break;
+    }
+    buffer[total] = '\0';
+    *buffer_out = buffer;
+    return total;
+}
+
 
 void handle_login_command(ClientState *client_state, const char *uid, const char *password) {
     if (client_state->is_logged_in) {
@@ -212,7 +312,7 @@ void handle_create_command(ClientState *client_state, const char *name, const ch
     long file_size = st.st_size;
 
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     char request_header[512];
     int header_len = snprintf(request_header, sizeof(request_header), "CRE %s %s %s %s %s %s %s %ld ",
@@ -232,11 +332,18 @@ void handle_create_command(ClientState *client_state, const char *name, const ch
     }
     fclose(file);
 
-    // sinalizar ao servidor que acabou o envio de dados
-    shutdown(tcp_fd, SHUT_WR);
+    if (tcp_fd == client_state->tcp_fd) {
+        // conexão persistente: os dados do ficheiro terminam com '\n', como os restantes pedidos
+        if (write(tcp_fd, "\n", 1) == -1) {
+            perror("Erro ao enviar dados do ficheiro TCP");
+        }
+    } else {
+        // sinalizar ao servidor que acabou o envio de dados
+        shutdown(tcp_fd, SHUT_WR);
+    }
 
     char response_buffer[128];
-    ssize_t n = read(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
+    ssize_t n = read_tcp_response(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
     
     if (n > 0) {
         response_buffer[n] = '\0';
@@ -264,31 +371,26 @@ void handle_create_command(ClientState *client_state, const char *name, const ch
     } else if (n < 0) {
         perror("Create falhou. Erro de comunicação com o servidor");
     }
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, n > 0);
 }
 
 
 void handle_list_command(ClientState *client_state) {
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     const char* request = "LST\n";
     if (write(tcp_fd, request, strlen(request)) == -1) {
         perror("Erro ao enviar pedido 'list'");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
 
-    char response_buffer[4096];
-    ssize_t total_bytes_read = 0;
-    ssize_t bytes_read;
-    while ((bytes_read = read(tcp_fd, response_buffer + total_bytes_read, sizeof(response_buffer) - total_bytes_read - 1)) > 0) {
-        total_bytes_read += bytes_read;
-    }
+    // a listagem pode ter qualquer tamanho: o buffer cresce conforme necessário
+    char *response_buffer = NULL;
+    ssize_t total_bytes_read = read_tcp_response_alloc(tcp_fd, &response_buffer);
 
     if (total_bytes_read > 0) {
-        response_buffer[total_bytes_read] = '\0';
-
         if (strncmp(response_buffer, "RLS NOK", 7) == 0) {
             printf("List falhou: nenhum evento criado.\n");
         
@@ -319,19 +421,20 @@ void handle_list_command(ClientState *client_state) {
     } else {
         perror("List falhou. Erro de comunicação com o servidor");
     }
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, total_bytes_read > 0 && response_buffer[total_bytes_read - 1] == '\n');
+    free(response_buffer);
 }
 
 
 void handle_show_command(ClientState *client_state, const char *eid) {
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     char request[16];
     snprintf(request, sizeof(request), "SED %s\n", eid);
     if (write(tcp_fd, request, strlen(request)) == -1) {
         perror("Erro ao enviar pedido 'show'");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
 
@@ -339,10 +442,11 @@ void handle_show_command(ClientState *client_state, const char *eid) {
     ssize_t bytes_read = read(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
     if (bytes_read <= 0) {
         printf("Show falhou. Servidor não respondeu ou fechou a conexão.\n");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
     response_buffer[bytes_read] = '\0';
+    bool complete = response_buffer[bytes_read - 1] == '\n';
 
     if (strncmp(response_buffer, "RSE NOK", 7) == 0) {
         printf("Show falhou: evento não encontrado.\n");
@@ -370,8 +474,10 @@ void handle_show_command(ClientState *client_state, const char *eid) {
             if (file == NULL) {
                 perror("Erro ao criar ficheiro local");
             } else {
-                // escrever a porção do ficheiro que já foi lida no buffer
+                // escrever a porção do ficheiro que já foi lida no buffer (sem o '\n' final da resposta)
                 long initial_data_len = bytes_read - header_len;
+                bool got_newline = initial_data_len > fsize;
+                if (got_newline) initial_data_len = fsize;
                 if (initial_data_len > 0) {
                     fwrite(response_buffer + header_len, 1, initial_data_len, file);
                 }
@@ -379,12 +485,19 @@ void handle_show_command(ClientState *client_state, const char *eid) {
                 // ler o resto do ficheiro do socket
                 long remaining_bytes = fsize - initial_data_len;
                 while (remaining_bytes > 0) {
-                    bytes_read = read(tcp_fd, response_buffer, sizeof(response_buffer));
+                    size_t to_read = remaining_bytes < (long)sizeof(response_buffer) ? (size_t)remaining_bytes : sizeof(response_buffer);
+                    bytes_read = read(tcp_fd, response_buffer, to_read);
                     if (bytes_read <= 0) break; // conexão fechada ou erro
                     fwrite(response_buffer, 1, bytes_read, file);
                     remaining_bytes -= bytes_read;
                 }
                 fclose(file);
+
+                // consumir o '\n' que termina a resposta, deixando a conexão pronta para o comando seguinte
+                if (remaining_bytes == 0 && !got_newline) {
+                    got_newline = read(tcp_fd, response_buffer, 1) == 1;
+                }
+                complete = remaining_bytes == 0 && got_newline;
                 printf("Ficheiro '%s' guardado com sucesso.\n", fname);
             }
         }
@@ -392,7 +505,7 @@ void handle_show_command(ClientState *client_state, const char *eid) {
         printf("Show falhou. Resposta inesperada do servidor: %s", response_buffer);
     }
 
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, complete);
 }
 
 
@@ -401,7 +514,7 @@ void handle_myevents_command(ClientState *client_state) {
     int udp_fd = create_udp_socket_and_connect(client_state, &server_addr);
 
     char request_buffer[128];
-    char response_buffer[4096];
+    char response_buffer[8192];
 
     snprintf(request_buffer, sizeof(request_buffer), "LME %s %s\n", client_state->current_uid, client_state->current_password);
     sendto(udp_fd, request_buffer, strlen(request_buffer), 0, (struct sockaddr*)&server_addr, sizeof(server_addr));
@@ -461,18 +574,18 @@ void handle_myevents_command(ClientState *client_state) {
 
 void handle_close_command(ClientState *client_state, const char *eid) {
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     char request[128];
     snprintf(request, sizeof(request), "CLS %s %s %s\n", client_state->current_uid, client_state->current_password, eid);
     if (write(tcp_fd, request, strlen(request)) == -1) {
         perror("Erro ao enviar pedido 'close'");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
 
     char response_buffer[128];
-    ssize_t n = read(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
+    ssize_t n = read_tcp_response(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
     
     if (n <= 0) {
         printf("Close falhou. Servidor não respondeu ou fechou a conexão.\n");
@@ -507,7 +620,7 @@ void handle_close_command(ClientState *client_state, const char *eid) {
             printf("Close falhou. Resposta inesperada do servidor: %s", response_buffer);
         }
     }
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, n > 0);
 }
 
 
@@ -519,18 +632,18 @@ void handle_reserve_command(ClientState *client_state, const char *eid, const ch
     }
 
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     char request[128];
     snprintf(request, sizeof(request), "RID %s %s %s %d\n", client_state->current_uid, client_state->current_password, eid, num_seats);
     if (write(tcp_fd, request, strlen(request)) == -1) {
         perror("Erro ao enviar pedido 'reserve'");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
 
     char response_buffer[128];
-    ssize_t n = read(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
+    ssize_t n = read_tcp_response(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
     
     if (n <= 0) {
         printf("Reserve falhou. Servidor não respondeu ou fechou a conexão.\n");
@@ -570,7 +683,7 @@ void handle_reserve_command(ClientState *client_state, const char *eid, const ch
             printf("Reserve falhou. Resposta do servidor: %s", response_buffer);
         }
     }
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, n > 0);
 }
 
 
@@ -628,18 +741,18 @@ void handle_myreservations_command(ClientState *client_state) {
 
 void handle_change_password_command(ClientState *client_state, const char *old_password, const char *new_password) {
     struct sockaddr_in server_addr;
-    int tcp_fd = create_tcp_socket_and_connect(client_state, &server_addr);
+    int tcp_fd = get_tcp_connection(client_state, &server_addr);
 
     char request[128];
     snprintf(request, sizeof(request), "CPS %s %s %s\n", client_state->current_uid, old_password, new_password);
     if (write(tcp_fd, request, strlen(request)) == -1) {
         perror("Erro ao enviar pedido 'changePass'");
-        close(tcp_fd);
+        release_tcp_connection(client_state, tcp_fd, false);
         return;
     }
 
     char response_buffer[128];
-    ssize_t n = read(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
+    ssize_t n = read_tcp_response(tcp_fd, response_buffer, sizeof(response_buffer) - 1);
     
     if (n <= 0) {
         printf("ChangePass falhou. Servidor não respondeu ou fechou a conexão.\n");
@@ -667,7 +780,7 @@ void handle_change_password_command(ClientState *client_state, const char *old_p
             printf("ChangePass falhou. Resposta inesperada do servidor: %s", response_buffer);
         }
     }
-    close(tcp_fd);
+    release_tcp_connection(client_state, tcp_fd, n > 0);
 }
 
 
@@ -676,6 +789,7 @@ void handle_exit_command(ClientState *client_state) {
         printf("Utilizador ainda com sessão iniciada. Por favor, execute o comando 'logout' primeiro.\n");
     } else {
         printf("A terminar a aplicação.\n");
+        if (client_state->tcp_fd >= 0) close(client_state->tcp_fd);
         exit(0);
     }
 }
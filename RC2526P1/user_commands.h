@@ -27,6 +27,10 @@ void handle_exit_command(ClientState *client_state);
 // Funções auxiliares de comunicação
 int create_udp_socket_and_connect(ClientState *client_state, struct sockaddr_in *server_addr_out);
 int create_tcp_socket_and_connect(ClientState *client_state, struct sockaddr_in *server_addr_out);
+int get_tcp_connection(ClientState *client_state, struct sockaddr_in *server_addr_out);
+void release_tcp_connection(ClientState *client_state, int tcp_fd, bool reusable);
+ssize_t read_tcp_response(int tcp_fd, char *buffer, size_t size);
+ssize_t read_tcp_response_alloc(int tcp_fd, char **buffer_out);
 
 
 #endif
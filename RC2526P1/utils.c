@@ -36,6 +36,21 @@ bool is_valid_uid(const char *uid) {
     return true;
 }
 
+/**
+ * Valida se um EID tem exatamente 3 caracteres e se são todos dígitos.
+ */
+bool is_valid_eid(const char *eid) {
+    if (strlen(eid) != 3) {
+        return false;
+    }
+    for (int i = 0; eid[i] != '\0'; i++) {
+        if (!isdigit((unsigned char)eid[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 /**
  * Valida se o nome de um evento tem no máximo 10 caracteres e se são todos alfanuméricos.
@@ -137,6 +152,30 @@ bool is_datetime_in_the_future(const char *datetime_str) {
 }
 
 
+/**
+ * Converte uma data dd-mm-yyyy hh:mm (os segundos, se existirem, são ignorados) em segundos desde a época.
+ */
+time_t datetime_to_epoch(const char *datetime_str) {
+    struct tm event_tm = {0};
+    sscanf(datetime_str, "%d-%d-%d %d:%d", &event_tm.tm_mday, &event_tm.tm_mon, &event_tm.tm_year, &event_tm.tm_hour, &event_tm.tm_min);
+    event_tm.tm_mon -= 1;
+    event_tm.tm_year -= 1900;
+    event_tm.tm_isdst = -1;
+    return mktime(&event_tm);
+}
+
+
+/**
+ * Escreve a data e hora atuais no formato dd-mm-yyyy HH:MM:SS.
+ */
+void format_current_datetime(char *buffer, size_t size) {
+    time_t now = time(NULL);
+    struct tm now_tm;
+    localtime_r(&now, &now_tm);
+    strftime(buffer, size, "%d-%m-%Y %H:%M:%S", &now_tm);
+}
+
+
 /**
  * Valida se o número de lugares é uma string que representa um inteiro entre 10 e 999.
  */
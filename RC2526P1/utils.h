@@ -2,12 +2,17 @@
 #define UTILS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 bool is_valid_password(const char *password);
 bool is_valid_uid(const char *uid);
+bool is_valid_eid(const char *eid);
 bool is_valid_event_name(const char *name);
 bool is_valid_event_filename(const char *filename);
 bool is_valid_datetime_format(const char *datetime_str);
 bool is_valid_number_attendees(const char *num_str);
 bool is_datetime_in_the_future(const char *datetime_str);
+time_t datetime_to_epoch(const char *datetime_str);
+void format_current_datetime(char *buffer, size_t size);
 #endif
\ No newline at end of file